@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Streaming aggregates
+//
+// With -DAGGREGATE=1 a fan-out kernel sits between the source and
+// prefixSumA() and copies every flit to two companion kernels, so one
+// read of the input feeds the scan and
+//
+//   windowSum():  the sum of the last AGG_WINDOW elements at every
+//                 element, as a second output stream, and the total
+//   histogram():  counts of the elements' values in HIST_BINS bins of
+//                 2^HIST_SHIFT values each, the last bin also taking
+//                 everything above
+//
+//   source ---> FanOut ---> prefixSumA -> prefixSumB ---> sink
+//                 |
+//                 +-------> windowSum --> window, total
+//                 |
+//                 +-------> histogram --> bins
+//
+// The window is a multiple of the flit width, K = AGG_WINDOW / W
+// flits, so the window sum of an element is its running sum less the
+// running sum K flits back, at the same index; windowSum() keeps the
+// last K flits of running sums in an on-chip ring.  Its only
+// loop-carried add is the running sum plus the flit total, as in
+// prefixSumB().  The sums are modulo 2^(bits of T), which is what
+// makes the subtraction exact, so the aggregates are of integer
+// streams only, whatever the scan's operator; segment heads are
+// ignored.
+//
+// histogram() gives each element lane of the flit its own bank of
+// counters, so the W updates of a flit never meet in one RAM, and
+// each bank HIST_COPIES copies used in turn, one per flit.  A counter
+// is then read, incremented and written back at most every
+// HIST_COPIES cycles, which is the RAM's read-modify-write latency at
+// II=1 (the same trick as CARRY_LANES).  The W * HIST_COPIES copies
+// are summed per bin at the end of the launch.
+//
+// The fan-out runs forever with the scan; the companions are launched
+// with the source and sink for each stream, by Aggregates<P>::run().
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef AGGREGATE
+#define AGGREGATE 0
+#endif
+
+#ifndef AGG_WINDOW
+#define AGG_WINDOW 1024
+#endif
+
+#ifndef HIST_BINS
+#define HIST_BINS 64
+#endif
+
+#ifndef HIST_SHIFT
+#define HIST_SHIFT 18
+#endif
+
+#ifndef HIST_COPIES
+#define HIST_COPIES 4
+#endif
+
+template <typename Tag> class TapPipe_id;
+template <typename Tag> class WindowPipe_id;
+template <typename Tag> class HistPipe_id;
+
+template <typename Tag> class FanOut_k;
+template <typename Tag> class WindowSum_k;
+template <typename Tag> class Histogram_k;
+
+// The datapath the source and sink of an aggregated stream over P are
+// launched for: the source writes the fan-out's own input pipe, and
+// the sink reads P's OutPipe as usual.
+template <typename P> struct Tapped : P {
+  struct Pipes : P::Pipes {
+    using InPipe = sycl::ext::intel::pipe<TapPipe_id<P>, typename P::Flit,
+                                          P::Depths::in>;
+  };
+};
+
+template <typename P> struct Aggregates {
+  using T = typename P::Value;
+  using U = std::make_unsigned_t<T>;
+  using F = typename P::Flit;
+  static constexpr int W = P::width;
+  static constexpr int K = AGG_WINDOW / W; // window, in flits
+
+  static_assert(std::is_integral<T>::value && !P::framed,
+                "aggregates are of integer, unframed streams");
+  static_assert(AGG_WINDOW % W == 0 && K >= 1,
+                "AGG_WINDOW must be a multiple of the flit width");
+  static_assert(HIST_BINS >= 1 && HIST_COPIES >= 1, "need bins and copies");
+
+  using TapPipe = typename Tapped<P>::Pipes::InPipe;
+  using WindowPipe =
+      sycl::ext::intel::pipe<WindowPipe_id<P>, F, P::Depths::in>;
+  using HistPipe = sycl::ext::intel::pipe<HistPipe_id<P>, F, P::Depths::in>;
+
+  // the histogram bin of value x
+  static int binOf(T x) {
+    U b = (U)x >> HIST_SHIFT;
+    return (b < (U)HIST_BINS) ? (int)b : HIST_BINS - 1;
+  }
+
+  // launch the scan kernels and the fan-out, back-to-front; they never
+  // terminate
+  static void launch(sycl::queue &q) {
+    submitPrefixSumAB<P>(q);
+    q.submit([&](sycl::handler &h) {
+      h.single_task<FanOut_k<P>>([=]() {
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        while (1) {
+          F flit = TapPipe::read();
+          P::Pipes::InPipe::write(flit);
+          WindowPipe::write(flit);
+          HistPipe::write(flit);
+        }
+      });
+    });
+  }
+
+  // Launch a kernel that stores the window sums of the next nflits
+  // flits to window and their total to *total.
+  static sycl::event
+  submitWindowSum(sycl::queue &q, F *window_, T *total, int64_t nflits,
+                  const std::vector<sycl::event> &deps = {}) {
+    SinkPtr<F> window = window_;
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<WindowSum_k<P>>([=]() {
+        U ring[K][W]; // running sums of the last K flits
+#pragma unroll
+        for (int i = 0; i < W; i++) {
+#pragma unroll
+          for (int k = 0; k < K; k++) {
+            ring[k][i] = 0;
+          }
+        }
+        U sumSoFar = 0;
+        int k = 0;
+
+        // a ring slot is read and rewritten once every K flits
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        [[intel::ivdep(ring, K)]]
+        for (int64_t f = 0; f < nflits; f++) {
+          F iflit = WindowPipe::read();
+          U x[W], incl[W];
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            x[i] = (U)iflit.element[i];
+          }
+          // the scan and total of the flit only read sumSoFar
+          P::Scan::template scan<SumOp<U>, W>(0, x, incl);
+          U flitSum = P::Scan::template reduce<SumOp<U>, W>(x);
+
+          F oflit = iflit;
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            U running = (U)(sumSoFar + incl[i]);
+            oflit.element[i] = (T)(running - ring[k][i]);
+            ring[k][i] = running;
+          }
+          window[f] = oflit;
+
+          sumSoFar = (U)(sumSoFar + flitSum);
+          k = (k == K - 1) ? 0 : k + 1;
+        }
+        *total = (T)sumSoFar;
+      });
+    });
+  }
+
+  // Launch a kernel that counts the values of the next nflits flits
+  // into bins[HIST_BINS].
+  static sycl::event
+  submitHistogram(sycl::queue &q, uint64_t *bins, int64_t nflits,
+                  const std::vector<sycl::event> &deps = {}) {
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<Histogram_k<P>>([=]() {
+        uint64_t count[W][HIST_COPIES][HIST_BINS];
+#pragma unroll
+        for (int i = 0; i < W; i++) {
+          for (int c = 0; c < HIST_COPIES; c++) {
+            for (int b = 0; b < HIST_BINS; b++) {
+              count[i][c][b] = 0;
+            }
+          }
+        }
+        int c = 0;
+
+        // copy c is touched again HIST_COPIES flits later
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        [[intel::ivdep(count, HIST_COPIES)]]
+        for (int64_t f = 0; f < nflits; f++) {
+          F iflit = HistPipe::read();
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            count[i][c][binOf(iflit.element[i])]++;
+          }
+          c = (c == HIST_COPIES - 1) ? 0 : c + 1;
+        }
+
+        for (int b = 0; b < HIST_BINS; b++) {
+          uint64_t n = 0;
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+#pragma unroll
+            for (int j = 0; j < HIST_COPIES; j++) {
+              n += count[i][j][b];
+            }
+          }
+          bins[b] = n;
+        }
+      });
+    });
+  }
+
+  // Streams nflits flits through P and the companions in one batch:
+  // the scan into out, the window sums into window, the histogram into
+  // bins[HIST_BINS] and the total into *total.  Staged through device
+  // memory unless ZERO_COPY.
+  static StreamEvents run(sycl::queue &q, const F *in, F *out, F *window,
+                          uint64_t *bins, T *total, int64_t nflits) {
+    StreamEvents ev;
+#if ZERO_COPY
+    sycl::event win = submitWindowSum(q, window, total, nflits);
+    sycl::event hist = submitHistogram(q, bins, nflits);
+    ev.lastSink = submitSink<Tapped<P>>(q, out, nflits);
+    ev.firstSource = submitSource<Tapped<P>>(q, in, nflits);
+    ev.lastSource = ev.firstSource;
+    ev.done = ev.lastSink;
+    sycl::event::wait({ev.done, win, hist});
+#else
+    F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+    F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+    F *dwindow = mallocStream<F>(nflits, q, SINK_LOCATION);
+    uint64_t *dbins = sycl::malloc_device<uint64_t>(HIST_BINS, q);
+    T *dtotal = sycl::malloc_device<T>(1, q);
+
+    sycl::event copyIn = q.memcpy(din, in, nflits * sizeof(F));
+    sycl::event win = submitWindowSum(q, dwindow, dtotal, nflits);
+    sycl::event hist = submitHistogram(q, dbins, nflits);
+    ev.lastSink = submitSink<Tapped<P>>(q, dout, nflits);
+    ev.firstSource = submitSource<Tapped<P>>(q, din, nflits, {copyIn});
+    ev.lastSource = ev.firstSource;
+    ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.lastSink);
+    sycl::event::wait(
+        {ev.done, q.memcpy(window, dwindow, nflits * sizeof(F), win),
+         q.memcpy(total, dtotal, sizeof(T), win),
+         q.memcpy(bins, dbins, HIST_BINS * sizeof(uint64_t), hist)});
+    sycl::free(din, q);
+    sycl::free(dout, q);
+    sycl::free(dwindow, q);
+    sycl::free(dbins, q);
+    sycl::free(dtotal, q);
+#endif
+    return ev;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Host references
+  //////////////////////////////////////////////////////////////////////
+
+  // Checks the window sums of the nflits flits of in.  Returns the
+  // index of the first wrong element, or -1.
+  static int64_t verifyWindow(const F *in, const F *window, int64_t nflits) {
+    int64_t n = nflits * W;
+    U sum = 0;
+    for (int64_t e = 0; e < n; e++) {
+      sum = (U)(sum + (U)in[e / W].element[e % W]);
+      if (e >= AGG_WINDOW) {
+        int64_t d = e - AGG_WINDOW;
+        sum = (U)(sum - (U)in[d / W].element[d % W]);
+      }
+      if ((U)window[e / W].element[e % W] != sum) {
+        return e;
+      }
+    }
+    return -1;
+  }
+
+  // the histogram of the nflits flits of in, and their total
+  static std::vector<uint64_t> hostHistogram(const F *in, int64_t nflits) {
+    std::vector<uint64_t> bins(HIST_BINS, 0);
+    for (int64_t f = 0; f < nflits; f++) {
+      for (int i = 0; i < W; i++) {
+        bins[binOf(in[f].element[i])]++;
+      }
+    }
+    return bins;
+  }
+
+  static T hostTotal(const F *in, int64_t nflits) {
+    U sum = 0;
+    for (int64_t f = 0; f < nflits; f++) {
+      for (int i = 0; i < W; i++) {
+        sum = (U)(sum + (U)in[f].element[i]);
+      }
+    }
+    return (T)sum;
+  }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Benchmark harness
+//
+// benchStream() streams the same input through a datapath a number of
+// warm-up times, then repeats times, and records for every repeat the
+// device time from the start of the first source kernel to the end of
+// the last sink kernel, so a sample covers the whole pipeline, and the
+// host wall time.  afterRun(r) is called after every run, r < 0 for
+// the warm-ups, while out holds that run's output.  BenchReport
+// collects one row per configuration, with min/median/p99 and GB/s,
+// and writes them as CSV or JSON for comparing bitstreams.
+//
+// SimpleVariant<P> is datapath P built with prefixSumSimple() instead
+// of the A/B pair; it needs its own pipes, since a pipe has one reader.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename P> struct SimpleVariant : P {
+  using Pipes = PipesOf<SimpleVariant, P>;
+};
+
+struct BenchSamples {
+  std::vector<double> deviceNs; // first source start to last sink end
+  std::vector<double> wallNs;   // host wall time of the whole call
+};
+
+template <typename P, typename Fn>
+BenchSamples benchStream(sycl::queue &q, const typename P::Flit *in,
+                         typename P::Flit *out, int64_t nflits,
+                         [[maybe_unused]] int64_t chunkFlits,
+                         [[maybe_unused]] int ringSlots, int warmup,
+                         int repeats, Fn &&afterRun) {
+  BenchSamples samples;
+  for (int r = -warmup; r < repeats; r++) {
+    auto wallStart = std::chrono::steady_clock::now();
+#if ZERO_COPY
+    StreamEvents ev = streamZeroCopy<P>(q, in, out, nflits);
+#else
+    StreamEvents ev =
+        streamChunked<P>(q, in, out, nflits, chunkFlits, ringSlots);
+#endif
+    double wall = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - wallStart)
+                      .count();
+    afterRun(r);
+    if (r < 0) {
+      continue;
+    }
+    samples.deviceNs.push_back(
+        ev.lastSink.template get_profiling_info<
+            sycl::info::event_profiling::command_end>() -
+        ev.firstSource.template get_profiling_info<
+            sycl::info::event_profiling::command_start>());
+    samples.wallNs.push_back(wall);
+  }
+  return samples;
+}
+
+// the p-th percentile (0..100) of x, nearest rank
+inline double percentile(std::vector<double> x, double p) {
+  if (x.empty()) {
+    return 0.0;
+  }
+  std::sort(x.begin(), x.end());
+  size_t rank = (size_t)(p / 100.0 * (x.size() - 1) + 0.5);
+  return x[std::min(rank, x.size() - 1)];
+}
+
+struct BenchRow {
+  std::string datapath;
+  std::string variant;
+  int64_t elements;
+  int64_t bytes;
+  int repeats;
+  double minUs;
+  double medianUs;
+  double p99Us;
+  double medianGBs;
+  double wallMedianUs;
+  bool correct;
+};
+
+class BenchReport {
+public:
+  void add(const std::string &datapath, const std::string &variant,
+           int64_t elements, int64_t bytes, const BenchSamples &s,
+           bool correct) {
+    BenchRow row;
+    row.datapath = datapath;
+    row.variant = variant;
+    row.elements = elements;
+    row.bytes = bytes;
+    row.repeats = (int)s.deviceNs.size();
+    row.minUs = percentile(s.deviceNs, 0) / 1E3;
+    row.medianUs = percentile(s.deviceNs, 50) / 1E3;
+    row.p99Us = percentile(s.deviceNs, 99) / 1E3;
+    row.medianGBs = row.medianUs > 0 ? bytes / (row.medianUs * 1E3) : 0.0;
+    row.wallMedianUs = percentile(s.wallNs, 50) / 1E3;
+    row.correct = correct;
+    rows_.push_back(row);
+
+    std::cout << datapath << " " << variant << " " << elements
+              << " elements: median " << row.medianUs << " us, "
+              << row.medianGBs << " GB/sec" << (correct ? "" : " INCORRECT")
+              << std::endl;
+  }
+
+  // CSV unless the file name ends in .json
+  bool write(const std::string &path) const {
+    std::ofstream f(path);
+    if (!f) {
+      std::cerr << "ERROR: cannot write " << path << "\n";
+      return false;
+    }
+    bool json = path.size() >= 5 && path.substr(path.size() - 5) == ".json";
+    if (json) {
+      writeJson(f);
+    } else {
+      writeCsv(f);
+    }
+    return true;
+  }
+
+  bool allCorrect() const {
+    return std::all_of(rows_.begin(), rows_.end(),
+                       [](const BenchRow &r) { return r.correct; });
+  }
+
+private:
+  void writeCsv(std::ostream &f) const {
+    f << "datapath,variant,elements,bytes,repeats,min_us,median_us,p99_us,"
+         "median_gbs,wall_median_us,correct\n";
+    for (const BenchRow &r : rows_) {
+      f << r.datapath << "," << r.variant << "," << r.elements << ","
+        << r.bytes << "," << r.repeats << "," << r.minUs << "," << r.medianUs
+        << "," << r.p99Us << "," << r.medianGBs << "," << r.wallMedianUs
+        << "," << (r.correct ? 1 : 0) << "\n";
+    }
+  }
+
+  void writeJson(std::ostream &f) const {
+    f << "[\n";
+    for (size_t i = 0; i < rows_.size(); i++) {
+      const BenchRow &r = rows_[i];
+      f << "  {\"datapath\": \"" << r.datapath << "\", \"variant\": \""
+        << r.variant << "\", \"elements\": " << r.elements
+        << ", \"bytes\": " << r.bytes << ", \"repeats\": " << r.repeats
+        << ", \"min_us\": " << r.minUs << ", \"median_us\": " << r.medianUs
+        << ", \"p99_us\": " << r.p99Us << ", \"median_gbs\": " << r.medianGBs
+        << ", \"wall_median_us\": " << r.wallMedianUs
+        << ", \"correct\": " << (r.correct ? "true" : "false") << "}"
+        << (i + 1 < rows_.size() ? "," : "") << "\n";
+    }
+    f << "]\n";
+  }
+
+  std::vector<BenchRow> rows_;
+};
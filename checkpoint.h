@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Checkpoint and resume
+//
+// prefixSumB()'s running sum lives in a never-ending kernel, so a
+// stream cut into pieces would otherwise need its carries added back
+// in by a second pass.  A resumable datapath, Resumable<P> over a
+// framed P, instead takes each framed stream's starting sum from the
+// host and hands back its final one:
+//
+//   SeedIn --> SeedPipe ---+
+//                          v
+//   source --> prefixSumA --> prefixSumB --> sink
+//                               |
+//                               +--> CarryPipe --> CarryOut
+//
+// For every stream (every eos) a tiny SeedIn kernel reads the seed
+// from a mailbox word of device memory into SeedPipe, which
+// prefixSumB() reads at the stream's first flit, and a tiny CarryOut
+// kernel stores the running sum after its last flit from CarryPipe to
+// a mailbox.  Both are in the operator's accumulator type (AccumOf),
+// so a piece resumes exactly where the last one stopped, even for
+// ExactSumOp.  The seed is only a mux on the carry, off the
+// loop-carried apply(), so II stays 1.
+//
+// A huge stream is then a series of jobs, each seeded with the last
+// one's carry.  On one device, streamResumedJobs() keeps the carry in
+// one word, each SeedIn depending on the last CarryOut, so the jobs
+// queue back to back with no host round trip; across launches or
+// devices only that word goes between them, copied through the host
+// (streamResumed()).  Every stream of a resumable datapath needs its
+// SeedIn and CarryOut, in stream order, or prefixSumB() waits for
+// them.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef CHECKPOINT
+#define CHECKPOINT 0
+#endif
+
+template <typename Tag> class SeedPipe_id;
+template <typename Tag> class CarryPipe_id;
+template <typename Tag> class SeedIn_k;
+template <typename Tag> class CarryOut_k;
+
+// datapath P with prefixSumB() seeded and checkpointed per stream; its
+// pipes are P's, plus the checkpoint pipes
+template <typename P> struct Resumable : P {
+  static_assert(P::framed, "checkpoints are taken at the ends of framed "
+                           "streams");
+  static_assert(P::window == 0 && P::streams == 0,
+                "only the plain prefixSumB() resumes");
+  struct Checkpoint {
+    static constexpr bool enabled = true;
+    // a stream's seed may be written while the last one is running
+    using SeedPipe =
+        sycl::ext::intel::pipe<SeedPipe_id<P>, typename P::Acc, 2>;
+    using CarryPipe =
+        sycl::ext::intel::pipe<CarryPipe_id<P>, typename P::Acc, 2>;
+  };
+};
+
+// Launch a kernel that sends *seed to P's prefixSumB() as the starting
+// sum of its next stream.
+template <typename P>
+sycl::event submitSeed(sycl::queue &q, const typename P::Acc *seed,
+                       const std::vector<sycl::event> &deps = {}) {
+  using SeedPipe = typename P::Checkpoint::SeedPipe;
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<SeedIn_k<P>>([=]() { SeedPipe::write(*seed); });
+  });
+}
+
+// Launch a kernel that stores the final sum of P's next stream to
+// *carry.
+template <typename P>
+sycl::event submitCarryOut(sycl::queue &q, typename P::Acc *carry,
+                           const std::vector<sycl::event> &deps = {}) {
+  using CarryPipe = typename P::Checkpoint::CarryPipe;
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<CarryOut_k<P>>([=]() { *carry = CarryPipe::read(); });
+  });
+}
+
+// Streams the jobs of in to out through resumable datapath P, as
+// streamFramed() does, as pieces of one longer stream: the first
+// resumes from seed, each next one from the last one's final carry,
+// and the last one's is returned.  The carry stays in one word of
+// device memory, so all the jobs are queued at once.  Staged through
+// device memory unless ZERO_COPY.  ev, if given, gets the jobs'
+// events.
+template <typename P>
+typename P::Acc streamResumedJobs(sycl::queue &q, const typename P::Flit *in,
+                                  typename P::Flit *out, int64_t nflits,
+                                  const std::vector<FramedJob> &jobs,
+                                  typename P::Acc seed,
+                                  StreamEvents *ev = nullptr) {
+  using F = typename P::Flit;
+  using A = typename P::Acc;
+  constexpr int W = P::width;
+
+#if ZERO_COPY
+  const F *din = in;
+  F *dout = out;
+  std::vector<sycl::event> copyIn;
+#else
+  F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+  F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+  // out too, for what the sink leaves alone
+  std::vector<sycl::event> copyIn = {q.memcpy(din, in, nflits * sizeof(F)),
+                                     q.memcpy(dout, out, nflits * sizeof(F))};
+#endif
+
+  // the mailbox: the seed of the next job, then the carry of the last
+  A *box = sycl::malloc_device<A>(1, q);
+  sycl::event carried = q.memcpy(box, &seed, sizeof(A));
+  StreamEvents e;
+  std::vector<sycl::event> prevSource = copyIn, prevSink = copyIn;
+  for (size_t j = 0; j < jobs.size(); j++) {
+    int64_t n = (jobs[j].nelems + W - 1) / W;
+    int lastValid = (int)(jobs[j].nelems - (n - 1) * W);
+    sycl::event seeded = submitSeed<P>(q, box, {carried});
+    carried = submitCarryOut<P>(q, box, {seeded});
+    sycl::event source = submitSource<P>(q, din + jobs[j].off, n, prevSource,
+                                         false, lastValid, true);
+    sycl::event sink = submitSink<P>(q, dout + jobs[j].off, n, prevSink);
+    if (j == 0) {
+      e.firstSource = source;
+    }
+    prevSource = {source};
+    prevSink = {sink};
+    e.lastSource = source;
+    e.lastSink = sink;
+  }
+
+#if ZERO_COPY
+  e.done = e.lastSink;
+#else
+  e.done = q.memcpy(out, dout, nflits * sizeof(F), e.lastSink);
+#endif
+  A carry = seed;
+  sycl::event::wait({e.done, q.memcpy(&carry, box, sizeof(A), carried)});
+#if !ZERO_COPY
+  sycl::free(din, q);
+  sycl::free(dout, q);
+#endif
+  sycl::free(box, q);
+  if (ev) {
+    *ev = e;
+  }
+  return carry;
+}
+
+// Streams a piece of nelems elements (at least 1) of a longer stream
+// from in to out through resumable datapath P, as one framed stream
+// starting from seed, and returns its final carry, to seed the next
+// piece with, in this launch or another.  ev, if given, gets the
+// piece's events.
+template <typename P>
+typename P::Acc streamResumed(sycl::queue &q, const typename P::Flit *in,
+                              typename P::Flit *out, int64_t nelems,
+                              typename P::Acc seed,
+                              StreamEvents *ev = nullptr) {
+  constexpr int W = P::width;
+  if (nelems < 1) {
+    std::cerr << "ERROR: a resumed piece needs at least 1 element\n";
+    std::terminate();
+  }
+  int64_t nflits = (nelems + W - 1) / W;
+  return streamResumedJobs<P>(q, in, out, nflits, {{0, nelems}}, seed, ev);
+}
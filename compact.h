@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Stream compaction
+//
+// Compactor<P, Pred> keeps the elements x of a stream of P's flits for
+// which Pred{}(x) is true, in order, packed into dense flits, on one
+// read of the input:
+//
+//   CompactSource --> mask --> prefixSumA -> prefixSumB --> Packer --> out
+//         |                                                   ^
+//         +------------------- SidePipe (the flits) ----------+
+//
+// The source turns each flit into a mask flit of 0/1 counts and
+// sends the data flit on a side pipe.  The mask runs through the A/B
+// kernels of its own segmented uint32 datapath, restarted at the
+// first flit of each launch, so it comes out as the number of kept
+// elements up to and including each element: element i of a flit is
+// kept if its count rose, and goes to output position count - 1.
+//
+// The packer needs no arithmetic on a loop-carried path: the fill
+// level of its partial output flit is the count before the flit,
+// which the scan delivered, not something it adds up.  A kept element
+// at position p lands in slot p % W of either the partial flit or the
+// next one, and each input flit adds at most W elements, so it
+// completes at most one output flit.  Per flit, a W x W crossbar of
+// slot compares fills both, the partial flit is stored if it filled
+// up, and the rest becomes the new partial flit; that is only muxes
+// on the loop-carried state, so the packer runs at II=1.  The last
+// partial flit is stored padded with T{}, and the count of kept
+// elements is returned.
+//
+// SidePipe holds a flit for as long as its mask takes through the
+// scan; it is as deep as the mask datapath's pipes together so the
+// source does not wait on it.  The counts are uint32, so a launch
+// keeps fewer than 2^32 elements.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMPACT
+#define COMPACT 0
+#endif
+
+// the datapath that scans the masks of Compactor<P, Pred>; its own tag
+// for its own pipes and kernels
+template <typename P, typename Pred>
+struct CompactMask : Datapath<SumOp<uint32_t>, true, typename P::Scan,
+                              P::width, false> {
+  using Pipes = PipesOf<
+      CompactMask,
+      Datapath<SumOp<uint32_t>, true, typename P::Scan, P::width, false>>;
+};
+
+template <typename Tag> class SidePipe_id;
+template <typename Tag> class CompactSource;
+template <typename Tag> class CompactPacker;
+
+template <typename P, typename Pred> struct Compactor {
+  using T = typename P::Value;
+  using F = typename P::Flit;
+  using M = CompactMask<P, Pred>;
+  using MF = typename M::Flit;
+  static constexpr int W = P::width;
+
+  static_assert(!P::segmented && !P::framed,
+                "compaction is of plain streams of flits");
+  static_assert((W & (W - 1)) == 0, "the flit width must be a power of 2");
+
+  using SidePipe = sycl::ext::intel::pipe<
+      SidePipe_id<M>, F,
+      M::Depths::in + M::Depths::data + M::Depths::sum + M::Depths::out>;
+
+  // launch the mask's scan kernels; they never terminate
+  static void launch(sycl::queue &q) { submitPrefixSumAB<M>(q); }
+
+  // Launch a kernel that reads nflits flits from USM memory and sends
+  // their masks to the scan and the flits to the packer.
+  static sycl::event submitSource(sycl::queue &q, const F *src_,
+                                  int64_t nflits,
+                                  const std::vector<sycl::event> &deps = {}) {
+    SourcePtr<const F> src = src_;
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<CompactSource<M>>([=]() {
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        for (int64_t f = 0; f < nflits; f++) {
+          F flit = src[f];
+          MF mask;
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            mask.element[i] = Pred{}(flit.element[i]) ? 1 : 0;
+          }
+          mask.heads = (f == 0) ? 1 : 0; // each launch counts from 0
+          M::Pipes::InPipe::write(mask);
+          SidePipe::write(flit);
+        }
+      });
+    });
+  }
+
+  // Launch a kernel that packs the kept elements of the next nflits
+  // flits into dst and stores how many there were to *count.
+  static sycl::event submitPacker(sycl::queue &q, F *dst_, uint32_t *count,
+                                  int64_t nflits,
+                                  const std::vector<sycl::event> &deps = {}) {
+    SinkPtr<F> dst = dst_;
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<CompactPacker<M>>([=]() {
+        F partial = {}; // the output flit being filled
+        uint32_t before = 0; // kept elements before this flit
+
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        for (int64_t f = 0; f < nflits; f++) {
+          MF kept = M::Pipes::OutPipe::read();
+          F flit = SidePipe::read();
+
+          // crossbar: slot j of this output flit and of the next
+          F cur = partial, next = {};
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            uint32_t prev = (i == 0) ? before : kept.element[i - 1];
+            uint32_t pos = kept.element[i] - 1;
+            bool keep = kept.element[i] != prev;
+            bool spills = pos / W != before / W;
+#pragma unroll
+            for (int j = 0; j < W; j++) {
+              if (keep && pos % W == (uint32_t)j) {
+                if (spills) {
+                  next.element[j] = flit.element[i];
+                } else {
+                  cur.element[j] = flit.element[i];
+                }
+              }
+            }
+          }
+
+          uint32_t after = kept.element[W - 1];
+          if (after / W != before / W) {
+            dst[before / W] = cur;
+            partial = next;
+          } else {
+            partial = cur;
+          }
+          before = after;
+        }
+
+        if (before % W != 0) {
+          dst[before / W] = partial;
+        }
+        *count = before;
+      });
+    });
+  }
+
+  // Compacts the nflits flits of in into out, which must have room for
+  // nflits flits, in one batch staged through device memory unless
+  // ZERO_COPY.  Returns the number of elements kept in kept.
+  static StreamEvents run(sycl::queue &q, const F *in, F *out,
+                          int64_t nflits, int64_t &kept) {
+    StreamEvents ev;
+    uint32_t n = 0;
+#if ZERO_COPY
+    uint32_t *dcount = sycl::malloc_host<uint32_t>(1, q);
+    ev.lastSink = submitPacker(q, out, dcount, nflits);
+    ev.firstSource = submitSource(q, in, nflits);
+    ev.lastSource = ev.firstSource;
+    ev.done = ev.lastSink;
+    ev.done.wait();
+    n = *dcount;
+#else
+    F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+    F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+    uint32_t *dcount = sycl::malloc_device<uint32_t>(1, q);
+    sycl::event copyIn = q.memcpy(din, in, nflits * sizeof(F));
+    ev.lastSink = submitPacker(q, dout, dcount, nflits);
+    ev.firstSource = submitSource(q, din, nflits, {copyIn});
+    ev.lastSource = ev.firstSource;
+    q.memcpy(&n, dcount, sizeof(n), ev.lastSink).wait();
+    ev.done = q.memcpy(out, dout, (n + W - 1) / W * sizeof(F));
+    ev.done.wait();
+    sycl::free(din, q);
+    sycl::free(dout, q);
+#endif
+    sycl::free(dcount, q);
+    kept = n;
+    return ev;
+  }
+
+  // Checks the kept elements of the nflits flits of in against out, n
+  // of them.  Returns the index of the first wrong output element (n
+  // if too few were kept), or -1.
+  static int64_t verify(const F *in, const F *out, int64_t nflits,
+                        int64_t n) {
+    int64_t k = 0;
+    for (int64_t e = 0; e < nflits * W; e++) {
+      T x = in[e / W].element[e % W];
+      if (!Pred{}(x)) {
+        continue;
+      }
+      if (k >= n || !(out[k / W].element[k % W] == x)) {
+        return k;
+      }
+      k++;
+    }
+    return (k == n) ? -1 : k;
+  }
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Packed streams
+//
+// Test streams are often small numbers in 64-bit elements, and the
+// prefix sums of non-negative input rise by those same small numbers,
+// so most of the bits the source reads and the sink writes are zeros.
+// With -DCOMPRESS=1 the source and sink move packed streams instead:
+//
+//   the stream is cut into blocks of PACK_FLITS flits.  A block whose
+//   elements all fit in B = 512 / (PACK_FLITS * W) bits is stored as
+//   one 64-byte word of B-bit fields; any other block is stored as its
+//   PACK_FLITS raw flits.  A flag byte per block says which.
+//
+// The packed source reads a block's word (or words) and unpacks it
+// into the InPipe a flit per cycle; the packed sink collects a block
+// from the OutPipe and packs the differences between successive
+// outputs, which for a sum are the inputs again.  The scan kernels
+// are unchanged.  The host packs the input and unpacks the output,
+// which is where the output's deltas are summed back up.  The input
+// is packed as is: delta-coding it would need a scan of its own in
+// front of the scan.
+//
+// Packing is lossless for every block, but only integer, unsegmented
+// streams are supported, and a launch must be a whole number of
+// blocks.  The sink's deltas start from 0 at every launch.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMPRESS
+#define COMPRESS 0
+#endif
+
+#ifndef PACK_FLITS
+#define PACK_FLITS 4
+#endif
+
+// one 64-byte word of packed stream memory
+using PackWord = FlitT<uint64_t, 8>;
+
+template <typename P> class PackedInput2Pipe;
+template <typename P> class Pipe2PackedOutput;
+
+template <typename P, int R = PACK_FLITS> struct PackFormat {
+  using T = typename P::Value;
+  using U = std::make_unsigned_t<T>;
+  using F = typename P::Flit;
+  static constexpr int W = P::width;
+  static constexpr int B = 512 / (R * W); // bits per packed element
+  static constexpr uint64_t kMask = ~uint64_t(0) >> (64 - B);
+
+  static_assert(std::is_integral<T>::value && !P::segmented && !P::framed,
+                "packed streams are integer, unsegmented and unframed");
+  static_assert(sizeof(F) == sizeof(PackWord), "a flit must be one word");
+  static_assert(R >= 1 && 512 % (R * W) == 0 && B >= 1,
+                "PACK_FLITS * W must divide 512");
+
+  static bool fits(U x) { return (uint64_t(x) & ~kMask) == 0; }
+
+  static PackWord rawWord(const F &flit) {
+    PackWord w;
+    std::memcpy(&w, &flit, sizeof(w));
+    return w;
+  }
+
+  static F rawFlit(const PackWord &w) {
+    F flit;
+    std::memcpy(&flit, &w, sizeof(flit));
+    return flit;
+  }
+
+  // flit j of a packed block; a B-bit field never straddles two limbs
+  static F unpack(const PackWord &w, int j) {
+    F flit;
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      int bit = (j * W + i) * B;
+      uint64_t v = w.element[bit / 64] >> (bit % 64);
+      flit.element[i] = (T)(v & kMask);
+    }
+    return flit;
+  }
+
+  // the fields of a block, each fits()
+  static PackWord pack(const U x[R * W]) {
+    PackWord w = {};
+#pragma unroll
+    for (int e = 0; e < R * W; e++) {
+      int bit = e * B;
+      w.element[bit / 64] |= uint64_t(x[e]) << (bit % 64);
+    }
+    return w;
+  }
+};
+
+// Launch a kernel that unpacks nflits flits (a multiple of R) from
+// words and flags into P's InPipe.
+template <typename P, int R = PACK_FLITS>
+sycl::event submitPackedSource(sycl::queue &q, const PackWord *words_,
+                               const uint8_t *flags, int64_t nflits,
+                               const std::vector<sycl::event> &deps = {}) {
+  using Fmt = PackFormat<P, R>;
+  using InPipe = typename P::Pipes::InPipe;
+  SourcePtr<const PackWord> words = words_;
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<PackedInput2Pipe<P>>([=]() {
+      PackWord held{};
+      bool packed = false;
+      int64_t w = 0;
+      int j = 0;
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      for (int64_t f = 0; f < nflits; f++) {
+        if (j == 0) {
+          packed = flags[f / R] != 0;
+        }
+        // a packed block is one word, read at its first flit
+        if (!packed || j == 0) {
+          held = words[w];
+          w++;
+        }
+        InPipe::write(packed ? Fmt::unpack(held, j) : Fmt::rawFlit(held));
+        j = (j == R - 1) ? 0 : j + 1;
+      }
+    });
+  });
+}
+
+// Launch a kernel that packs nflits flits (a multiple of R) of P's
+// OutPipe, as deltas, into words and flags, and stores the number of
+// words used to *nwords.
+template <typename P, int R = PACK_FLITS>
+sycl::event submitPackedSink(sycl::queue &q, PackWord *words_, uint8_t *flags,
+                             int64_t *nwords, int64_t nflits,
+                             const std::vector<sycl::event> &deps = {}) {
+  using Fmt = PackFormat<P, R>;
+  using U = typename Fmt::U;
+  using F = typename P::Flit;
+  constexpr int W = P::width;
+  using OutPipe = typename P::Pipes::OutPipe;
+  SinkPtr<PackWord> words = words_;
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<Pipe2PackedOutput<P>>([=]() {
+      F block[R] = {};
+      U prev = 0; // the last element of the previous block
+      int64_t w = 0;
+      int j = 0;
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      for (int64_t f = 0; f < nflits; f++) {
+#pragma unroll
+        for (int k = 0; k < R - 1; k++) {
+          block[k] = block[k + 1];
+        }
+        block[R - 1] = OutPipe::read();
+
+        if (j == R - 1) {
+          U delta[R * W];
+          bool fits = true;
+#pragma unroll
+          for (int e = 0; e < R * W; e++) {
+            U x = (U)block[e / W].element[e % W];
+            U before = (e == 0)
+                           ? prev
+                           : (U)block[(e - 1) / W].element[(e - 1) % W];
+            delta[e] = (U)(x - before);
+            fits = fits && Fmt::fits(delta[e]);
+          }
+          PackWord packedWord = Fmt::pack(delta);
+
+          flags[f / R] = fits;
+#pragma unroll
+          for (int k = 0; k < R; k++) {
+            if (!fits || k == 0) {
+              words[w + k] = fits ? packedWord : Fmt::rawWord(block[k]);
+            }
+          }
+          w += fits ? 1 : R;
+          prev = (U)block[R - 1].element[W - 1];
+        }
+        j = (j == R - 1) ? 0 : j + 1;
+      }
+      *nwords = w;
+    });
+  });
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Host side of packed streams
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename P, int R = PACK_FLITS> struct PackedStream {
+  std::vector<PackWord> words;
+  std::vector<uint8_t> flags;
+};
+
+// packs the nflits flits of in (a multiple of R), as deltas if delta
+template <typename P, int R = PACK_FLITS>
+PackedStream<P, R> packStream(const typename P::Flit *in, int64_t nflits,
+                              bool delta = false) {
+  using Fmt = PackFormat<P, R>;
+  using U = typename Fmt::U;
+  constexpr int W = P::width;
+  PackedStream<P, R> s;
+  U prev = 0;
+  for (int64_t b = 0; b < nflits / R; b++) {
+    const typename P::Flit *block = in + b * R;
+    U x[R * W];
+    bool fits = true;
+    for (int e = 0; e < R * W; e++) {
+      U v = (U)block[e / W].element[e % W];
+      x[e] = delta ? (U)(v - prev) : v;
+      prev = v;
+      fits = fits && Fmt::fits(x[e]);
+    }
+    s.flags.push_back(fits);
+    if (fits) {
+      s.words.push_back(Fmt::pack(x));
+    } else {
+      for (int k = 0; k < R; k++) {
+        s.words.push_back(Fmt::rawWord(block[k]));
+      }
+    }
+  }
+  return s;
+}
+
+// the inverse of packStream() into the nflits flits of out
+template <typename P, int R = PACK_FLITS>
+void unpackStream(const PackWord *words, const uint8_t *flags, int64_t nflits,
+                  typename P::Flit *out, bool delta = false) {
+  using Fmt = PackFormat<P, R>;
+  using U = typename Fmt::U;
+  using T = typename P::Value;
+  constexpr int W = P::width;
+  U prev = 0;
+  int64_t w = 0;
+  for (int64_t b = 0; b < nflits / R; b++) {
+    bool packed = flags[b] != 0;
+    for (int k = 0; k < R; k++) {
+      typename P::Flit &flit = out[b * R + k];
+      if (packed) {
+        flit = Fmt::unpack(words[w], k);
+        for (int i = 0; i < W && delta; i++) {
+          prev = (U)(prev + (U)flit.element[i]);
+          flit.element[i] = (T)prev;
+        }
+      } else {
+        flit = Fmt::rawFlit(words[w + k]);
+        prev = (U)flit.element[W - 1];
+      }
+    }
+    w += packed ? 1 : R;
+  }
+}
+
+// Streams nflits flits (a multiple of PACK_FLITS) through datapath P
+// packed: in is packed on the host, moved and unpacked by the packed
+// source, and the packed sink's output is unpacked into out.  Staged
+// through device memory unless ZERO_COPY; the packing and unpacking
+// are not part of the kernels' span.  inWords and outWords return the
+// 64-byte words the source read and the sink wrote.
+template <typename P, int R = PACK_FLITS>
+StreamEvents streamPacked(sycl::queue &q, const typename P::Flit *in,
+                          typename P::Flit *out, int64_t nflits,
+                          int64_t &inWords, int64_t &outWords) {
+  if (nflits % R != 0) {
+    std::cerr << "ERROR: packed stream of " << nflits
+              << " flits is not a multiple of " << R << " flit blocks\n";
+    std::terminate();
+  }
+  int64_t nblocks = nflits / R;
+  PackedStream<P, R> packed = packStream<P, R>(in, nflits);
+  inWords = (int64_t)packed.words.size();
+
+  // the sink may need every block raw
+#if ZERO_COPY
+  PackWord *din = sycl::malloc_host<PackWord>(inWords, q);
+  PackWord *dout = sycl::malloc_host<PackWord>(nflits, q);
+  uint8_t *dinFlags = sycl::malloc_host<uint8_t>(nblocks, q);
+  uint8_t *doutFlags = sycl::malloc_host<uint8_t>(nblocks, q);
+#else
+  PackWord *din = mallocStream<PackWord>(inWords, q, SOURCE_LOCATION);
+  PackWord *dout = mallocStream<PackWord>(nflits, q, SINK_LOCATION);
+  uint8_t *dinFlags = sycl::malloc_device<uint8_t>(nblocks, q);
+  uint8_t *doutFlags = sycl::malloc_device<uint8_t>(nblocks, q);
+#endif
+  int64_t *dcount = sycl::malloc_device<int64_t>(1, q);
+
+  sycl::event copyIn =
+      q.memcpy(din, packed.words.data(), inWords * sizeof(PackWord));
+  sycl::event copyFlags = q.memcpy(dinFlags, packed.flags.data(), nblocks);
+
+  StreamEvents ev;
+  ev.lastSink = submitPackedSink<P, R>(q, dout, doutFlags, dcount, nflits);
+  ev.firstSource =
+      submitPackedSource<P, R>(q, din, dinFlags, nflits, {copyIn, copyFlags});
+  ev.lastSource = ev.firstSource;
+  ev.lastSink.wait();
+
+  q.memcpy(&outWords, dcount, sizeof(int64_t)).wait();
+  std::vector<PackWord> words(outWords);
+  std::vector<uint8_t> flags(nblocks);
+  sycl::event copyWords =
+      q.memcpy(words.data(), dout, outWords * sizeof(PackWord));
+  ev.done = q.memcpy(flags.data(), doutFlags, nblocks);
+  sycl::event::wait({copyWords, ev.done});
+  unpackStream<P, R>(words.data(), flags.data(), nflits, out, true);
+
+  sycl::free(din, q);
+  sycl::free(dout, q);
+  sycl::free(dinFlags, q);
+  sycl::free(doutFlags, q);
+  sycl::free(dcount, q);
+  return ev;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Multi-device scale-out
+//
+// One board's memory bandwidth caps a single stream.  A scan splits
+// across boards with almost no communication, so MultiDevice<P> runs
+// one stream over every device of the primary queue's platform (all
+// the boards of the BSP), each with its own copy of the datapath:
+//
+//   1. the stream is cut into parts, dealt round-robin over the
+//      devices, and each device scans its parts as framed jobs, each
+//      from the identity, all devices at once
+//   2. the host reads the last element of every part, that part's
+//      total, and scans those in order into each part's offset, the
+//      sum of all the parts before it (an exclusive scan)
+//   3. each device applies its parts' offsets to their outputs in
+//      device memory, an add-only kernel at II=1, before copying them
+//      back
+//
+// Step 3 costs another pass over each part's output in its own
+// board's memory, which runs in parallel over the boards, not over
+// PCIe.  The offset is applied to the lowered outputs, so this is for
+// operators that scan in their value type (Acc == Value); a part's
+// last output is then its exact total.  The datapath must be framed,
+// so that every job starts over, and unsegmented.
+//
+// Each device has its own queue and kernels; launch() starts the
+// processing kernels on all of them.  The primary queue is the first.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MULTI_DEVICE
+#define MULTI_DEVICE 0
+#endif
+
+// parts per stream; 0 is one per device
+#ifndef DEVICE_PARTS
+#define DEVICE_PARTS 0
+#endif
+
+// A queue on every device of q's platform, q's own first, made once.
+// The others get handler and profiling like q.
+template <typename H>
+std::vector<sycl::queue> &deviceQueues(sycl::queue &q, H handler) {
+  static std::vector<sycl::queue> queues;
+  if (queues.empty()) {
+    queues.push_back(q);
+    sycl::device primary = q.get_device();
+    for (const sycl::device &d : primary.get_platform().get_devices()) {
+      if (d != primary) {
+        queues.push_back(sycl::queue(
+            d, handler, sycl::property::queue::enable_profiling{}));
+      }
+    }
+  }
+  return queues;
+}
+
+template <typename Tag> class AddOffset_k;
+
+template <typename P> struct MultiDevice {
+  using T = typename P::Value;
+  using F = typename P::Flit;
+  using Op = typename P::Op;
+  static constexpr int W = P::width;
+
+  static_assert(P::framed && !P::segmented,
+                "parts are framed jobs of an unsegmented stream");
+  static_assert(std::is_same<typename P::Acc, T>::value,
+                "offsets are applied to the outputs in the value type");
+
+  // launch the processing kernels on every device; they never terminate
+  static void launch(std::vector<sycl::queue> &queues) {
+    for (sycl::queue &q : queues) {
+      submitPrefixSumAB<P>(q);
+    }
+  }
+
+  // Launch a kernel that applies offset to the elements of the nflits
+  // flits of buf in place, only the first lastValid of the last flit.
+  static sycl::event submitAddOffset(sycl::queue &q, F *buf, int64_t nflits,
+                                     int lastValid, T offset,
+                                     const std::vector<sycl::event> &deps) {
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<AddOffset_k<P>>([=]() {
+        // every flit is its own
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        [[intel::ivdep]]
+        for (int64_t f = 0; f < nflits; f++) {
+          F flit = buf[f];
+          int valid = (f == nflits - 1) ? lastValid : W;
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            if (i < valid) {
+              flit.element[i] = Op::apply(offset, flit.element[i]);
+            }
+          }
+          buf[f] = flit;
+        }
+      });
+    });
+  }
+
+  // Scans the nelems elements of in into out over the devices of
+  // queues, in nparts parts (0: one per device).  Returns the number
+  // of parts.
+  static int run(std::vector<sycl::queue> &queues, const F *in, F *out,
+                 int64_t nelems, int nparts = 0) {
+    int ndev = (int)queues.size();
+    int64_t nflits = (nelems + W - 1) / W;
+    nparts = (nparts > 0) ? nparts : ndev;
+    nparts = (int)std::max<int64_t>(1, std::min<int64_t>(nparts, nflits));
+
+    struct Part {
+      sycl::queue *q;
+      int64_t off, nflits; // flits of in and out
+      int lastValid;
+      F *din, *dout;
+      sycl::event sink;
+      T total;
+    };
+    std::vector<Part> parts(nparts);
+    std::vector<std::vector<sycl::event>> prevSource(ndev), prevSink(ndev);
+    for (int k = 0; k < nparts; k++) {
+      Part &p = parts[k];
+      int d = k % ndev;
+      p.q = &queues[d];
+      p.off = nflits * k / nparts;
+      p.nflits = nflits * (k + 1) / nparts - p.off;
+      p.lastValid = (k == nparts - 1) ? (int)(nelems - (nflits - 1) * W) : W;
+      p.din = mallocStream<F>(p.nflits, *p.q, SOURCE_LOCATION);
+      p.dout = mallocStream<F>(p.nflits, *p.q, SINK_LOCATION);
+
+      sycl::event copyIn =
+          p.q->memcpy(p.din, in + p.off, p.nflits * sizeof(F));
+      std::vector<sycl::event> srcDeps = prevSource[d];
+      srcDeps.push_back(copyIn);
+      // the last flit of out too, for what the sink leaves alone
+      std::vector<sycl::event> sinkDeps = prevSink[d];
+      sinkDeps.push_back(p.q->memcpy(&p.dout[p.nflits - 1],
+                                     &out[p.off + p.nflits - 1], sizeof(F)));
+      // a part is a framed job, so each starts from the identity
+      sycl::event source = submitSource<P>(*p.q, p.din, p.nflits, srcDeps,
+                                           false, p.lastValid, true);
+      p.sink = submitSink<P>(*p.q, p.dout, p.nflits, sinkDeps);
+      prevSource[d] = {source};
+      prevSink[d] = {p.sink};
+    }
+
+    // the parts' totals, and the exclusive scan of them on the host
+    for (Part &p : parts) {
+      p.q->memcpy(&p.total, &p.dout[p.nflits - 1].element[p.lastValid - 1],
+                  sizeof(T), p.sink)
+          .wait();
+    }
+    std::vector<sycl::event> copies;
+    T offset = Op::identity();
+    for (Part &p : parts) {
+      sycl::event ready = p.sink;
+      if (&p != &parts[0]) {
+        ready = submitAddOffset(*p.q, p.dout, p.nflits, p.lastValid, offset,
+                                {p.sink});
+      }
+      copies.push_back(
+          p.q->memcpy(out + p.off, p.dout, p.nflits * sizeof(F), ready));
+      offset = Op::apply(offset, p.total);
+    }
+    sycl::event::wait(copies);
+    for (Part &p : parts) {
+      sycl::free(p.din, *p.q);
+      sycl::free(p.dout, *p.q);
+    }
+    return nparts;
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//////////////////////////////////////////////////////////////////////////////
+// Exact sums
+//
+// A double prefix sum rounds at every add, so its result depends on
+// the order of the adds, and a double carry update is a multi-cycle
+// FADD on the loop-carried path.  ExactSumOp<T> instead accumulates in
+// a two's complement fixed-point number of EXACT_LIMBS 64-bit limbs,
+// EXACT_FRAC_BITS of them below the binary point: each element is
+// converted to it exactly, the adds are exact integer adds, and each
+// output is rounded once, to nearest even, back to T.  So the result
+// is the correctly rounded prefix sum, the same for every network and
+// CARRY_LANES, and the loop-carried add is an integer add with a carry
+// chain, like the uint64 datapath's but EXACT_LIMBS times as long.
+//
+// This is a Kulisch accumulator cut down to the range the stream needs
+// rather than all of double's: magnitudes must stay below
+// 2^(64 * EXACT_LIMBS - EXACT_FRAC_BITS - 1) (2^63 by default) or the
+// sum wraps, and bits of an element below 2^-EXACT_FRAC_BITS are
+// dropped (rounded towards zero).  Infinities and NaNs are not
+// supported.  For integer T the fraction bits stay zero and the
+// output is the sum modulo 2^(bits of T), as SumOp's.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef EXACT_LIMBS
+#define EXACT_LIMBS 2
+#endif
+
+#ifndef EXACT_FRAC_BITS
+#define EXACT_FRAC_BITS 64
+#endif
+
+// limb[0] is the least significant
+template <int Limbs, int FracBits> struct Fixed {
+  uint64_t limb[Limbs];
+};
+
+template <int Limbs, int FracBits> struct FixedSumOp {
+  using value_type = Fixed<Limbs, FracBits>;
+  static constexpr bool commutative = true;
+  static value_type identity() { return {}; }
+  static value_type apply(value_type x, value_type y) {
+    value_type r;
+    uint64_t carry = 0;
+#pragma unroll
+    for (int k = 0; k < Limbs; k++) {
+      uint64_t s = x.limb[k] + y.limb[k];
+      uint64_t c = s < x.limb[k];
+      r.limb[k] = s + carry;
+      carry = c | (r.limb[k] < s);
+    }
+    return r;
+  }
+};
+
+template <typename T, int Limbs = EXACT_LIMBS, int FracBits = EXACT_FRAC_BITS>
+struct ExactSumOp {
+  static_assert(std::is_same<T, double>::value || std::is_integral<T>::value,
+                "ExactSumOp sums doubles or integers");
+  static_assert(FracBits >= 0 && FracBits < 64 * Limbs - 1,
+                "need an integer part");
+  static_assert(FracBits <= 1022 && 64 * Limbs - FracBits <= 1024,
+                "the range must round to normal doubles");
+
+  using value_type = T;
+  using Acc = Fixed<Limbs, FracBits>;
+  using AccOp = FixedSumOp<Limbs, FracBits>;
+  static constexpr bool commutative = true;
+  static T identity() { return T{}; }
+
+  // x exactly, up to the dropped bits below 2^-FracBits
+  static Acc lift(T x) {
+    uint64_t m;
+    int s; // m is shifted left by s
+    bool neg;
+    if constexpr (std::is_same<T, double>::value) {
+      uint64_t bits;
+      std::memcpy(&bits, &x, sizeof(bits));
+      int e = (int)((bits >> 52) & 0x7ff);
+      m = bits & ((uint64_t(1) << 52) - 1);
+      if (e != 0) {
+        m |= uint64_t(1) << 52; // hidden bit; e == 0 is subnormal
+      } else {
+        e = 1;
+      }
+      s = e - 1075 + FracBits;
+      neg = (bits >> 63) != 0;
+    } else {
+      neg = false;
+      if constexpr (std::is_signed<T>::value) {
+        neg = x < 0;
+      }
+      m = neg ? uint64_t(0) - (uint64_t)x : (uint64_t)x;
+      s = FracBits;
+    }
+
+    Acc r;
+#pragma unroll
+    for (int k = 0; k < Limbs; k++) {
+      int d = s - 64 * k; // where m's bit 0 lands in limb k
+      if (d >= 0) {
+        r.limb[k] = (d < 64) ? m << d : 0;
+      } else {
+        r.limb[k] = (d > -64) ? m >> -d : 0;
+      }
+    }
+    return neg ? negate(r) : r;
+  }
+
+  // a, rounded to nearest even
+  static T lower(const Acc &a) {
+    bool neg = (a.limb[Limbs - 1] >> 63) != 0;
+    Acc mag = neg ? negate(a) : a;
+
+    if constexpr (std::is_same<T, double>::value) {
+      int p = -1; // most significant set bit
+#pragma unroll
+      for (int k = 0; k < Limbs; k++) {
+        if (mag.limb[k] != 0) {
+          p = 64 * k + 63 - __builtin_clzll(mag.limb[k]);
+        }
+      }
+      if (p < 0) {
+        return 0.0;
+      }
+
+      // the 53 bits from p down, and the round and sticky bits below
+      int lo = p - 52;
+      uint64_t mant;
+      bool round = false, sticky = false;
+      if (lo <= 0) {
+        mant = mag.limb[0] << -lo;
+      } else {
+        mant = bitsAt(mag, lo) & ((uint64_t(1) << 53) - 1);
+        round = bitsAt(mag, lo - 1) & 1;
+        sticky = anyBelow(mag, lo - 1);
+      }
+      int e = p - FracBits;
+      if (round && (sticky || (mant & 1))) {
+        mant++;
+        if (mant >> 53) {
+          mant >>= 1;
+          e++;
+        }
+      }
+
+      uint64_t bits = (uint64_t)neg << 63 | (uint64_t)(e + 1023) << 52 |
+                      (mant & ((uint64_t(1) << 52) - 1));
+      double r;
+      std::memcpy(&r, &bits, sizeof(r));
+      return r;
+    } else {
+      // the integer part, modulo 2^64
+      return (T)bitsAt(a, FracBits);
+    }
+  }
+
+private:
+  static Acc negate(const Acc &a) {
+    Acc r;
+    uint64_t carry = 1;
+#pragma unroll
+    for (int k = 0; k < Limbs; k++) {
+      r.limb[k] = ~a.limb[k] + carry;
+      carry = carry & (r.limb[k] == 0);
+    }
+    return r;
+  }
+
+  // the 64 bits of a from bit i up, zero above the top
+  static uint64_t bitsAt(const Acc &a, int i) {
+    int k = i / 64, r = i % 64;
+    uint64_t w = 0;
+#pragma unroll
+    for (int j = 0; j < Limbs; j++) {
+      if (j == k) {
+        w |= a.limb[j] >> r;
+      } else if (j == k + 1 && r != 0) {
+        w |= a.limb[j] << (64 - r);
+      }
+    }
+    return w;
+  }
+
+  // whether any of bits 0 .. i-1 of a is set
+  static bool anyBelow(const Acc &a, int i) {
+    bool any = false;
+#pragma unroll
+    for (int j = 0; j < Limbs; j++) {
+      int n = i - 64 * j; // bits of limb j below i
+      uint64_t mask = (n >= 64) ? ~uint64_t(0)
+                      : (n > 0) ? (uint64_t(1) << n) - 1
+                                : 0;
+      any = any || (a.limb[j] & mask) != 0;
+    }
+    return any;
+  }
+};
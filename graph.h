@@ -0,0 +1,330 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Fused streaming graphs
+//
+// Every stage fused into one pipeline saves a pass over memory, but
+// each link between kernels is a pipe type of its own, declared and
+// wired by hand.  Graph<P, Stages...> generates them: the stages run
+// in order over P's element type, width and framing, stage I reading
+// the pipe Link<I> and writing Link<I + 1>,
+//
+//   source --> Link<0> --> stage 0 --> Link<1> --> ... --> stage N-1
+//                                                              |
+//   sink <------------------------- OutPipe <------------------+
+//
+// where Link<0> is the graph's InPipe and Link<N> its OutPipe.  Each
+// link is tagged with its graph and stage, so every graph, and every
+// stage of one, is its own hardware.  launch() starts the stages back
+// to front, like main() does the A/B kernels, and they never
+// terminate.  The stages are
+//
+//   ScanStage<TOp, TScan>  the A/B kernels of TOp over the stage's
+//                          pipes, with their own DataPipe and SumPipe
+//   FilterStage<Pred>      elements x with Pred{}(x) false become P's
+//                          identity, the padding of a framed job, so
+//                          a scan or reduction after it skips them;
+//                          until a scan has consumed them, every such
+//                          stage must be of P::Op.  Compaction, which
+//                          changes the flit count, is Compactor
+//                          (compact.h)
+//   ReduceStage<TOp>       passes the stream through and, at every eos
+//                          of a framed graph, sends its stream's TOp
+//                          total to a result pipe
+//
+// All stages move a flit per cycle, so the sink takes as many flits as
+// the source sends.  The graph is a datapath to the rest of the code:
+// streamChunked(), streamFramed() and streamZeroCopy() run it, and an
+// unframed integer graph moves to and from memory packed with
+// streamPacked() (compress.h).  streamGraph() runs one job through it
+// and collects its ReduceStage totals; every stream of a graph with a
+// ReduceStage needs those result kernels, or the graph waits for them,
+// as with checkpoint.h.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef STREAM_GRAPH
+#define STREAM_GRAPH 0
+#endif
+
+// the tag of stage I of graph G, for its pipes and kernels
+template <typename G, int I> class GraphStage;
+
+template <typename Tag> class ReducePipe_id;
+template <typename Tag> class Filter_k;
+template <typename Tag> class Reduce_k;
+template <typename Tag> class ReduceOut_k;
+
+template <typename P, typename... TStages> struct Graph : P {
+  static_assert(sizeof...(TStages) >= 1, "a graph needs a stage");
+  static_assert(!P::segmented && P::window == 0 && P::streams == 0 &&
+                    !P::Checkpoint::enabled,
+                "a graph is over a plain or framed stream");
+  static_assert(HasIdentity<typename P::Op>::value,
+                "a graph pads and filters with P's identity()");
+
+  static constexpr int stages = sizeof...(TStages);
+  template <int I>
+  using Stage = std::tuple_element_t<I, std::tuple<TStages...>>;
+
+  // the pipe into stage I, the graph's OutPipe after the last one
+  template <int I>
+  using Link =
+      std::conditional_t<(I < stages),
+                         typename PipesOf<GraphStage<Graph, I>, P>::InPipe,
+                         typename PipesOf<Graph, P>::OutPipe>;
+
+  struct Pipes : PipesOf<Graph, P> {
+    using InPipe = Link<0>;
+  };
+
+  // the number of ReduceStage totals of a stream, and the index of
+  // stage I's among them
+  static constexpr int results = (0 + ... + (int)TStages::reduces);
+  template <int I> static constexpr int resultIndex() {
+    constexpr bool reduces[] = {TStages::reduces...};
+    int n = 0;
+    for (int k = 0; k < I; k++) {
+      n += reduces[k];
+    }
+    return n;
+  }
+
+  // whether stage I reads a FilterStage's identity() padding: a
+  // FilterStage comes before it, and no ScanStage in between
+  template <int I> static constexpr bool filtered() {
+    constexpr bool pads[] = {TStages::pads...};
+    constexpr bool scans[] = {TStages::scans...};
+    bool f = false;
+    for (int k = 0; k < I; k++) {
+      f = pads[k] || (f && !scans[k]);
+    }
+    return f;
+  }
+
+  // call f(std::integral_constant<int, I>{}) for every stage I, in order
+  template <typename Fn> static void forEachStage(Fn &&f) {
+    forEachStage(f, std::make_integer_sequence<int, stages>{});
+  }
+
+  // launch the stages, back-to-front; they never terminate
+  static void launch(sycl::queue &q) { launchFrom<stages - 1>(q); }
+
+private:
+  template <typename Fn, int... Is>
+  static void forEachStage(Fn &f, std::integer_sequence<int, Is...>) {
+    (f(std::integral_constant<int, Is>{}), ...);
+  }
+
+  template <int I> static void launchFrom(sycl::queue &q) {
+    Stage<I>::template submit<Graph, I>(q);
+    if constexpr (I > 0) {
+      launchFrom<I - 1>(q);
+    }
+  }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Stages
+//////////////////////////////////////////////////////////////////////////////
+
+// Scan stage I of G as a datapath of its own, so submitPrefixSumAB()
+// builds it: its A/B kernels read the graph's pipe into the stage and
+// write the one out of it, and its DataPipe and SumPipe are its own.
+template <typename G, int I, typename TOp, typename TScan>
+struct ScanStagePath : Datapath<TOp, false, TScan, G::width, G::framed> {
+  using Base = Datapath<TOp, false, TScan, G::width, G::framed>;
+  struct Pipes : PipesOf<ScanStagePath, Base> {
+    using InPipe = typename G::template Link<I>;
+    using OutPipe = typename G::template Link<I + 1>;
+  };
+};
+
+template <typename TOp, typename TScan = SCAN_NETWORK> struct ScanStage {
+  static constexpr bool reduces = false;
+  static constexpr bool pads = false;
+  static constexpr bool scans = true;
+
+  template <typename G, int I> static void submit(sycl::queue &q) {
+    static_assert(std::is_same<typename TOp::value_type,
+                               typename G::Value>::value,
+                  "a scan stage scans the graph's elements");
+    static_assert(!G::template filtered<I>() ||
+                      std::is_same<TOp, typename G::Op>::value,
+                  "after a filter, only the graph's operator skips its "
+                  "identity()");
+    submitPrefixSumAB<ScanStagePath<G, I, TOp, TScan>>(q);
+  }
+};
+
+template <typename Pred> struct FilterStage {
+  static constexpr bool reduces = false;
+  static constexpr bool pads = true;
+  static constexpr bool scans = false;
+
+  template <typename G, int I> static void submit(sycl::queue &q) {
+    using InPipe = typename G::template Link<I>;
+    using OutPipe = typename G::template Link<I + 1>;
+    using F = PipeData<InPipe>;
+    q.submit([&](sycl::handler &h) {
+      h.single_task<Filter_k<GraphStage<G, I>>>([=]() {
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        while (1) {
+          F flit = InPipe::read(); // framing passes through
+#pragma unroll
+          for (int i = 0; i < F::width; i++) {
+            if (!Pred{}(flit.element[i])) {
+              flit.element[i] = G::Op::identity();
+            }
+          }
+          OutPipe::write(flit);
+        }
+      });
+    });
+  }
+};
+
+// The total of each framed stream under TOp, over its valid elements
+// only, so a padded last flit does not count whatever P's identity is.
+// The running total is a CarryLanes like prefixSumB()'s, so
+// CARRY_LANES relaxes its loop-carried apply().
+template <typename TOp, typename TScan = SCAN_NETWORK> struct ReduceStage {
+  static constexpr bool reduces = true;
+  static constexpr bool pads = false;
+  static constexpr bool scans = false;
+  using T = typename TOp::value_type;
+
+  // a stream's total may be written while the last one's is unread
+  template <typename G, int I>
+  using ResultPipe =
+      sycl::ext::intel::pipe<ReducePipe_id<GraphStage<G, I>>, T, 2>;
+
+  template <typename G, int I> static void submit(sycl::queue &q) {
+    static_assert(G::framed, "a reduction ends at the end of a framed stream");
+    static_assert(std::is_same<T, typename G::Value>::value,
+                  "a reduce stage reduces the graph's elements");
+    static_assert(!G::template filtered<I>() ||
+                      std::is_same<TOp, typename G::Op>::value,
+                  "after a filter, only the graph's operator skips its "
+                  "identity()");
+    using InPipe = typename G::template Link<I>;
+    using OutPipe = typename G::template Link<I + 1>;
+    using F = PipeData<InPipe>;
+    using Acc = AccumOf<TOp>;
+    using AOp = typename Acc::Op;
+    constexpr int W = F::width;
+    q.submit([&](sycl::handler &h) {
+      h.single_task<Reduce_k<GraphStage<G, I>>>([=]() {
+        CarryLanes<AOp, defaultCarryLanes<TOp, F>(), false> carry;
+
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        while (1) {
+          F flit = InPipe::read();
+          AccOf<TOp> x[W];
+#pragma unroll
+          for (int i = 0; i < W; i++) {
+            x[i] = ((flit.valid >> i) & 1) ? Acc::lift(flit.element[i])
+                                           : AOp::identity();
+          }
+          carry.add(TScan::template reduce<AOp, W>(x));
+          if (flit.eos) {
+            ResultPipe<G, I>::write(Acc::lower(carry.sum()));
+            carry.reset(); // the next flit starts a new stream
+          }
+          OutPipe::write(flit);
+        }
+      });
+    });
+  }
+
+  // Launch a kernel that stores the total of G's next stream at stage
+  // I to *total.
+  template <typename G, int I>
+  static sycl::event submitResult(sycl::queue &q, T *total,
+                                  const std::vector<sycl::event> &deps = {}) {
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<ReduceOut_k<GraphStage<G, I>>>(
+          [=]() { *total = ResultPipe<G, I>::read(); });
+    });
+  }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Host side of graphs
+//////////////////////////////////////////////////////////////////////////////
+
+// Streams the nelems elements of in through graph G into out, as one
+// framed job on a framed G (whole flits otherwise), and stores the
+// job's ReduceStage totals, in stage order, to totals[G::results].
+// Staged through device memory unless ZERO_COPY; the totals come
+// through device memory either way, as a host USM word is not
+// something every board has.
+template <typename G>
+StreamEvents streamGraph(sycl::queue &q, const typename G::Flit *in,
+                         typename G::Flit *out, int64_t nelems,
+                         typename G::Value *totals = nullptr) {
+  using F [[maybe_unused]] = typename G::Flit;
+  using T = typename G::Value;
+  constexpr int W = G::width;
+  if (nelems < 1 || (!G::framed && nelems % W != 0)) {
+    std::cerr << "ERROR: a graph job of " << nelems << " elements; it needs "
+              << "at least 1, and whole flits of " << W << " unless framed\n";
+    std::terminate();
+  }
+  int64_t nflits = (nelems + W - 1) / W;
+  int lastValid = (int)(nelems - (nflits - 1) * W);
+
+  T *box = (G::results > 0) ? sycl::malloc_device<T>(G::results, q) : nullptr;
+  std::vector<sycl::event> stored;
+  G::forEachStage([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using S = typename G::template Stage<I>;
+    if constexpr (S::reduces) {
+      stored.push_back(S::template submitResult<G, I>(
+          q, &box[G::template resultIndex<I>()]));
+    }
+  });
+
+  StreamEvents ev;
+#if ZERO_COPY
+  ev.lastSink = submitSink<G>(q, out, nflits);
+  ev.firstSource = submitSource<G>(q, in, nflits, {}, false, lastValid, true);
+  ev.lastSource = ev.firstSource;
+  ev.done = ev.lastSink;
+#else
+  F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+  F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+  // the last flit of out too, for what the sink leaves alone
+  sycl::event copyIn = q.memcpy(din, in, nflits * sizeof(F));
+  sycl::event copyOut =
+      q.memcpy(&dout[nflits - 1], &out[nflits - 1], sizeof(F));
+  ev.lastSink = submitSink<G>(q, dout, nflits, {copyOut});
+  ev.firstSource =
+      submitSource<G>(q, din, nflits, {copyIn}, false, lastValid, true);
+  ev.lastSource = ev.firstSource;
+  ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.lastSink);
+#endif
+  ev.done.wait();
+#if !ZERO_COPY
+  sycl::free(din, q);
+  sycl::free(dout, q);
+#endif
+  if (box && totals) {
+    q.memcpy(totals, box, G::results * sizeof(T), stored).wait();
+  } else {
+    sycl::event::wait(stored);
+  }
+  if (box) {
+    sycl::free(box, q);
+  }
+  return ev;
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Work-group scan for CPU and GPU devices
+//
+// The A/B kernels are never-ending single_tasks over pipes: one work-
+// item doing everything, which is what an FPGA wants and the worst
+// case for a CPU or GPU.  With -DGROUP_SCAN=1 a build for those runs
+// the same datapath's scan as one data-parallel nd_range kernel in a
+// single pass over memory instead, streamGroupScan():
+//
+//   - each work-group takes the next tile of GS_GROUP * GS_FLITS flits,
+//     in the order the groups start (a tile counter, not the group id)
+//   - each work-item scans its GS_FLITS flits serially, in registers,
+//     and the group scans the work-items' totals: with
+//     inclusive_scan_over_group() where the accumulator's operator is
+//     a SYCL one on an arithmetic type, SumOp, MaxOp, MinOp and XorOp,
+//     and over local memory otherwise
+//   - decoupled look-back: the tile publishes its total (AGGREGATE),
+//     then walks back over its predecessors' published values, adding
+//     in their totals until it meets one that has published its
+//     inclusive prefix (PREFIX), and publishes its own PREFIX; a tile
+//     rarely waits for more than its neighbour
+//   - each work-item applies the tile's and its own carry-in and
+//     stores its outputs
+//
+// The serial scans vectorize over flit elements on the CPU, and the
+// look-back costs a few words per tile, so the scan runs at close to
+// memory bandwidth.  Everything composes in stream order, so any
+// operator works; the grouping differs from the A/B kernels', like
+// blockCarries() on the host.  Look-back needs tiles to make progress
+// in start order, which tiles numbered by the counter get on every CPU
+// and GPU runtime in practice, though SYCL does not promise it.
+//
+// Only the plain stream: unsegmented and unframed, no pipes.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef GROUP_SCAN
+#define GROUP_SCAN 0
+#endif
+
+// work-items per work-group, and flits per work-item
+#ifndef GS_GROUP
+#define GS_GROUP 256
+#endif
+
+#ifndef GS_FLITS
+#define GS_FLITS 4
+#endif
+
+// the SYCL function object for TOp, for the group algorithms, or void
+template <typename TOp> struct GroupOpOf {
+  using type = void;
+};
+template <typename T> struct GroupOpOf<SumOp<T>> {
+  using type = std::conditional_t<std::is_arithmetic<T>::value, sycl::plus<T>,
+                                  void>;
+};
+template <typename T> struct GroupOpOf<MaxOp<T>> {
+  using type = std::conditional_t<std::is_arithmetic<T>::value,
+                                  sycl::maximum<T>, void>;
+};
+template <typename T> struct GroupOpOf<MinOp<T>> {
+  using type = std::conditional_t<std::is_arithmetic<T>::value,
+                                  sycl::minimum<T>, void>;
+};
+template <typename T> struct GroupOpOf<XorOp<T>> {
+  using type = sycl::bit_xor<T>;
+};
+
+// a tile's published state, in GroupScanTile::flag
+enum : uint32_t { kTileEmpty = 0, kTileAggregate = 1, kTilePrefix = 2 };
+
+template <typename A> struct GroupScanTile {
+  uint32_t flag;
+  A aggregate; // the tile's own total
+  A prefix;    // the total of the stream up to and including the tile
+};
+
+template <typename Tag> class GroupScan_k;
+
+// Launch the scan of the nflits flits of in into out.  tiles has room
+// for a GroupScanTile per tile and counter is 0; both are device
+// memory.
+template <typename P>
+sycl::event submitGroupScan(sycl::queue &q, const typename P::Flit *in,
+                            typename P::Flit *out, int64_t nflits,
+                            GroupScanTile<typename P::Acc> *tiles,
+                            uint32_t *counter,
+                            const std::vector<sycl::event> &deps = {}) {
+  using F = typename P::Flit;
+  using A = typename P::Acc;
+  using Acc = AccumOf<typename P::Op>;
+  using AOp = typename Acc::Op;
+  using GroupOp = typename GroupOpOf<AOp>::type;
+  constexpr int W = P::width;
+  constexpr int kTileFlits = GS_GROUP * GS_FLITS;
+  static_assert(!P::segmented && !P::framed,
+                "the group scan is of plain streams");
+  int64_t ntiles = (nflits + kTileFlits - 1) / kTileFlits;
+
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    sycl::local_accessor<A, 1> scratch(sycl::range<1>(GS_GROUP), h);
+    sycl::local_accessor<A, 1> carryIn(sycl::range<1>(1), h);
+    sycl::local_accessor<uint32_t, 1> tileId(sycl::range<1>(1), h);
+    h.parallel_for<GroupScan_k<P>>(
+        sycl::nd_range<1>(sycl::range<1>(ntiles * GS_GROUP),
+                          sycl::range<1>(GS_GROUP)),
+        [=](sycl::nd_item<1> it) {
+          using Flag = sycl::atomic_ref<uint32_t, sycl::memory_order::acq_rel,
+                                        sycl::memory_scope::device,
+                                        sycl::access::address_space::
+                                            global_space>;
+          auto g = it.get_group();
+          int lid = (int)it.get_local_id(0);
+
+          // tiles in the order the groups start
+          if (lid == 0) {
+            tileId[0] = Flag(*counter).fetch_add(1u);
+          }
+          sycl::group_barrier(g);
+          int64_t t = tileId[0];
+
+          // the work-item's flits, scanned in registers
+          int64_t first = t * kTileFlits + (int64_t)lid * GS_FLITS;
+          A incl[GS_FLITS][W];
+          A sum = AOp::identity();
+          for (int k = 0; k < GS_FLITS; k++) {
+            int64_t f = first + k;
+#pragma unroll
+            for (int i = 0; i < W; i++) {
+              if (f < nflits) {
+                sum = AOp::apply(sum, Acc::lift(in[f].element[i]));
+              }
+              incl[k][i] = sum;
+            }
+          }
+
+          // the work-items' totals, scanned over the group; the
+          // inclusive scans stay in scratch for the carry-ins below
+          A groupIncl;
+          if constexpr (!std::is_void<GroupOp>::value) {
+            groupIncl = sycl::inclusive_scan_over_group(g, sum, GroupOp{});
+            scratch[lid] = groupIncl;
+          } else {
+            scratch[lid] = sum;
+            for (int d = 1; d < GS_GROUP; d *= 2) {
+              sycl::group_barrier(g);
+              A v = (lid >= d) ? AOp::apply(scratch[lid - d], scratch[lid])
+                               : scratch[lid];
+              sycl::group_barrier(g);
+              scratch[lid] = v;
+            }
+            sycl::group_barrier(g);
+            groupIncl = scratch[lid];
+          }
+
+          // decoupled look-back, by the tile's last work-item, which
+          // holds its total
+          if (lid == GS_GROUP - 1) {
+            A before = AOp::identity();
+            if (t == 0) {
+              tiles[0].prefix = groupIncl;
+              Flag(tiles[0].flag).store(kTilePrefix,
+                                        sycl::memory_order::release);
+            } else {
+              tiles[t].aggregate = groupIncl;
+              Flag(tiles[t].flag).store(kTileAggregate,
+                                        sycl::memory_order::release);
+              for (int64_t j = t - 1;; j--) {
+                uint32_t flag;
+                do {
+                  flag = Flag(tiles[j].flag).load(sycl::memory_order::acquire);
+                } while (flag == kTileEmpty);
+                if (flag == kTilePrefix) {
+                  before = AOp::apply(tiles[j].prefix, before);
+                  break;
+                }
+                before = AOp::apply(tiles[j].aggregate, before);
+              }
+              tiles[t].prefix = AOp::apply(before, groupIncl);
+              Flag(tiles[t].flag).store(kTilePrefix,
+                                        sycl::memory_order::release);
+            }
+            carryIn[0] = before;
+          }
+          sycl::group_barrier(g);
+
+          // carry-in of the work-item: the tile's, then the group's
+          // exclusive scan, the inclusive one of the work-item before,
+          // which the barrier above made visible
+          A mine = carryIn[0];
+          if (lid > 0) {
+            mine = AOp::apply(mine, scratch[lid - 1]);
+          }
+          for (int k = 0; k < GS_FLITS; k++) {
+            int64_t f = first + k;
+            if (f < nflits) {
+              F oflit;
+#pragma unroll
+              for (int i = 0; i < W; i++) {
+                oflit.element[i] = Acc::lower(AOp::apply(mine, incl[k][i]));
+              }
+              out[f] = oflit;
+            }
+          }
+        });
+  });
+}
+
+// Scans the nflits flits of in into out with submitGroupScan(), in
+// one batch staged through device memory unless ZERO_COPY.  The
+// stream starts from the identity; there is no state between calls.
+template <typename P>
+StreamEvents streamGroupScan(sycl::queue &q, const typename P::Flit *in,
+                             typename P::Flit *out, int64_t nflits) {
+  using F [[maybe_unused]] = typename P::Flit;
+  using Tile = GroupScanTile<typename P::Acc>;
+  constexpr int kTileFlits = GS_GROUP * GS_FLITS;
+  int64_t ntiles = (nflits + kTileFlits - 1) / kTileFlits;
+  Tile *tiles = sycl::malloc_device<Tile>(ntiles, q);
+  uint32_t *counter = sycl::malloc_device<uint32_t>(1, q);
+  std::vector<sycl::event> zeroed = {
+      q.memset(tiles, 0, ntiles * sizeof(Tile)),
+      q.memset(counter, 0, sizeof(uint32_t))};
+
+  StreamEvents ev;
+#if ZERO_COPY
+  ev.firstSource = submitGroupScan<P>(q, in, out, nflits, tiles, counter,
+                                      zeroed);
+  ev.done = ev.firstSource;
+#else
+  F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+  F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+  zeroed.push_back(q.memcpy(din, in, nflits * sizeof(F)));
+  ev.firstSource =
+      submitGroupScan<P>(q, din, dout, nflits, tiles, counter, zeroed);
+  ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.firstSource);
+#endif
+  ev.lastSource = ev.firstSource;
+  ev.lastSink = ev.firstSource;
+  ev.done.wait();
+#if !ZERO_COPY
+  sycl::free(din, q);
+  sycl::free(dout, q);
+#endif
+  sycl::free(tiles, q);
+  sycl::free(counter, q);
+  return ev;
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#include "scan.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Zero-copy host memory
+//
+// With -DZERO_COPY=1, the source and sink kernels read and write USM
+// host (or shared) allocations directly, so flits go host->pipe and
+// pipe->host with no staging copy through board DDR.  This needs a BSP
+// with host USM support, such as ofs_n6001_usm.  On hardware the
+// pointers are annotated with the host memory's buffer_location (from
+// the BSP's board_spec.xml; HOST_BUFFER_LOCATION) and a full 64-byte
+// data width so each flit is one burst beat.  Since a pipe can only
+// have one writer and one reader, a build uses one kind of pointer or
+// the other throughout.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef ZERO_COPY
+#define ZERO_COPY 0
+#endif
+
+#ifndef HOST_BUFFER_LOCATION
+#define HOST_BUFFER_LOCATION 1
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// DDR bank placement
+//
+// Device buffers are burst-interleaved over all of the board's DDR
+// banks by default (on B2E2_8GBx4, all four), so the source's reads
+// and the sink's writes share every memory controller.  With
+// -DDDR_SPLIT=1 the input buffers instead go to IN_BUFFER_LOCATION and
+// the output buffers to OUT_BUFFER_LOCATION, so reads and writes each
+// get their own banks.  The locations are global memory ids from the
+// BSP's board_spec.xml; for banks of one interleaved global memory,
+// also build with -Xsno-interleaving=DDR (NO_INTERLEAVE in the Makefile).
+//
+// On hardware the source and sink pointers are annotated with their
+// buffer location, a 512-bit data width and maximal bursts, so each
+// kernel gets one wide burst-coalesced LSU.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef DDR_SPLIT
+#define DDR_SPLIT 0
+#endif
+
+#ifndef DDR_BUFFER_LOCATION
+#define DDR_BUFFER_LOCATION 0
+#endif
+
+#ifndef IN_BUFFER_LOCATION
+#define IN_BUFFER_LOCATION 0
+#endif
+
+#ifndef OUT_BUFFER_LOCATION
+#define OUT_BUFFER_LOCATION 1
+#endif
+
+// where the source reads and the sink writes
+#if ZERO_COPY
+#define SOURCE_LOCATION HOST_BUFFER_LOCATION
+#define SINK_LOCATION HOST_BUFFER_LOCATION
+#elif DDR_SPLIT
+#define SOURCE_LOCATION IN_BUFFER_LOCATION
+#define SINK_LOCATION OUT_BUFFER_LOCATION
+#else
+#define SOURCE_LOCATION DDR_BUFFER_LOCATION
+#define SINK_LOCATION DDR_BUFFER_LOCATION
+#endif
+
+// what the source and sink kernels are handed; Bits is the width of
+// the LSU's data bus, a 64-byte flit by default
+#if FPGA_HARDWARE || FPGA_SIMULATOR
+template <typename T, int Loc, int Bits = 512>
+using StreamPtr = sycl::ext::oneapi::experimental::annotated_arg<
+    T *, decltype(sycl::ext::oneapi::experimental::properties{
+             sycl::ext::intel::experimental::buffer_location<Loc>,
+             sycl::ext::intel::experimental::dwidth<Bits>,
+#if ZERO_COPY
+             sycl::ext::intel::experimental::latency<0>
+#else
+             sycl::ext::intel::experimental::maxburst<16>
+#endif
+         })>;
+#else
+template <typename T, int Loc, int Bits = 512> using StreamPtr = T *;
+#endif
+
+template <typename T> using SourcePtr = StreamPtr<T, SOURCE_LOCATION>;
+template <typename T> using SinkPtr = StreamPtr<T, SINK_LOCATION>;
+// a source of one small word per flit, such as a StreamTag, read
+// through an LSU as wide as the word
+template <typename T>
+using SourceWordPtr = StreamPtr<T, SOURCE_LOCATION, (int)(8 * sizeof(T))>;
+
+// Device memory for Loc; plain device USM when not on hardware.  Not
+// for ZERO_COPY builds, whose kernels expect host pointers.
+template <typename T>
+T *mallocStream(size_t n, sycl::queue &q, [[maybe_unused]] int loc) {
+#if FPGA_HARDWARE || FPGA_SIMULATOR
+  return sycl::malloc_device<T>(
+      n, q,
+      sycl::property_list{
+          sycl::ext::intel::experimental::property::usm::buffer_location(
+              loc)});
+#else
+  return sycl::malloc_device<T>(n, q);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Source and sink kernels
+//
+// The source copies flits from USM memory into a datapath's InPipe,
+// and the sink copies flits from its OutPipe back to USM memory.  A
+// pipe has exactly one writer and one reader kernel, so every way of
+// feeding a datapath goes through these two kernels; each launch
+// moves one contiguous run of flits.
+//
+// Same-named kernels are chained through deps by the callers below so
+// that successive launches consume the stream in order.
+//
+// On a framed datapath (see FramedFlit) a launch's last flit may be
+// partial: the source marks the first lastValid elements valid and
+// fills the rest with the identity, and ends the stream there if eos.
+// The sink stores only the valid elements of each flit, so a job of
+// any length runs without padding, and jobs run back to back.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename P> class Input2Pipe;
+template <typename P> class Pipe2Output;
+
+// flit i of the nflits of a source launch, as P's InPipe carries it
+template <typename P>
+PipeData<typename P::Pipes::InPipe>
+sourceFlit(const typename P::Flit &in, int64_t i, int64_t nflits, bool restart,
+           [[maybe_unused]] int lastValid, [[maybe_unused]] bool eos) {
+  using PF = PipeData<typename P::Pipes::InPipe>;
+  constexpr int W = P::width;
+  PF flit{};
+  static_cast<typename P::Flit &>(flit) = in;
+  if constexpr (P::framed) {
+    bool last = (i == nflits - 1);
+    flit.valid = validMask<W>(last ? lastValid : W);
+    flit.eos = last && eos;
+#pragma unroll
+    for (int k = 0; k < W; k++) {
+      if (((flit.valid >> k) & 1) == 0) {
+        flit.element[k] = P::Op::identity();
+      }
+    }
+    if constexpr (P::segmented) {
+      flit.heads &= flit.valid;
+    }
+  }
+  if constexpr (P::segmented) {
+    if (restart && i == 0) {
+      flit.heads |= 1;
+    }
+  }
+  return flit;
+}
+
+// store flit, as P's OutPipe carries it, to out: only its valid
+// elements on a framed datapath
+template <typename P, typename PF>
+void sinkStore(typename P::Flit &out, const PF &flit) {
+  if constexpr (P::framed) {
+    if (flit.valid != validMask<P::width>(P::width)) {
+#pragma unroll
+      for (int k = 0; k < P::width; k++) {
+        if ((flit.valid >> k) & 1) {
+          out.element[k] = flit.element[k];
+        }
+      }
+      if constexpr (P::segmented) {
+        out.heads = flit.heads;
+      }
+      return;
+    }
+  }
+  out = flit;
+}
+
+// Launch a kernel that copies input data from USM memory into a pipe.
+// On a segmented datapath, restart marks the first element as a
+// segment head so the run is scanned independently of what came
+// before.  On a framed datapath, the last flit has lastValid valid
+// elements and ends the stream if eos.
+template <typename P>
+sycl::event submitSource(sycl::queue &q, const typename P::Flit *src_,
+                         int64_t nflits,
+                         const std::vector<sycl::event> &deps = {},
+                         bool restart = false, int lastValid = P::width,
+                         bool eos = false) {
+  using InPipe = typename P::Pipes::InPipe;
+  SourcePtr<const typename P::Flit> src = src_;
+#if TELEMETRY
+  StageStats *stats = telemetryStats<P>(q) + kStageSource;
+#endif
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<Input2Pipe<P>>([=]() {
+#if TELEMETRY
+      StageCounter c;
+      PipeData<InPipe> flit{};
+      bool holding = false;
+      int64_t i = 0;
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      while (i < nflits) {
+        if (!holding) {
+          flit = sourceFlit<P>(src[i], i, nflits, restart, lastValid, eos);
+          holding = true;
+        }
+        if (c.tryWrite<InPipe>(flit)) {
+          holding = false;
+          i++;
+          c.active();
+        } else {
+          c.writeStall();
+        }
+      }
+      c.accumulate(stats);
+#else
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      for (int64_t i = 0; i < nflits; i++) {
+        InPipe::write(
+            sourceFlit<P>(src[i], i, nflits, restart, lastValid, eos));
+      }
+#endif
+    });
+  });
+}
+
+// Launch a kernel that copies output data from a pipe to USM memory
+template <typename P>
+sycl::event submitSink(sycl::queue &q, typename P::Flit *dst_, int64_t nflits,
+                       const std::vector<sycl::event> &deps = {}) {
+  using OutPipe = typename P::Pipes::OutPipe;
+  SinkPtr<typename P::Flit> dst = dst_;
+#if TELEMETRY
+  StageStats *stats = telemetryStats<P>(q) + kStageSink;
+#endif
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<Pipe2Output<P>>([=]() {
+#if TELEMETRY
+      StageCounter c;
+      int64_t i = 0;
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      while (i < nflits) {
+        PipeData<OutPipe> flit;
+        if (c.tryRead<OutPipe>(flit)) {
+          sinkStore<P>(dst[i], flit);
+          i++;
+          c.active();
+        } else {
+          c.readStall();
+        }
+      }
+      c.accumulate(stats);
+#else
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      for (int64_t i = 0; i < nflits; i++) {
+        sinkStore<P>(dst[i], OutPipe::read());
+      }
+#endif
+    });
+  });
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Chunked streaming host I/O
+//
+// streamChunked() moves a host stream through a datapath chunk by
+// chunk, over a ring of ringSlots device buffers per direction.  For
+// chunk c in slot s = c % ringSlots:
+//
+//   host->device copy of c   waits for the source of chunk c-ringSlots
+//                            to finish reading slot s
+//   source kernel on c       waits for that copy and source of c-1
+//   sink kernel on c         waits for the device->host copy of chunk
+//                            c-ringSlots out of slot s, and sink of c-1
+//   device->host copy of c   waits for the sink of c
+//
+// so with ringSlots >= 2 the copies of chunk c+1 overlap the kernels
+// working on chunk c.  The scan state carries across chunks; to the
+// datapath it is one continuous stream.  With one chunk and one slot
+// this is the plain copy-in, run, copy-out batch.
+//
+// Host memory should be USM host (pinned) memory for the copies to
+// actually run concurrently with the kernels.  Not for ZERO_COPY
+// builds, whose kernels expect host pointers.
+//////////////////////////////////////////////////////////////////////////////
+
+struct StreamEvents {
+  sycl::event firstSource; // start of the first source kernel
+  sycl::event lastSource;  // end of the last source kernel
+  sycl::event lastSink;    // end of the last sink kernel
+  sycl::event done;        // last device->host copy
+};
+
+#if !ZERO_COPY
+template <typename P>
+StreamEvents streamChunked(sycl::queue &q, const typename P::Flit *in,
+                           typename P::Flit *out, int64_t nflits,
+                           int64_t chunkFlits, int ringSlots = 2) {
+  using F = typename P::Flit;
+
+  chunkFlits = std::max<int64_t>(1, std::min(chunkFlits, nflits));
+  int64_t nchunks = (nflits + chunkFlits - 1) / chunkFlits;
+  ringSlots = (int)std::max<int64_t>(1, std::min<int64_t>(ringSlots, nchunks));
+
+  std::vector<F *> inSlot(ringSlots), outSlot(ringSlots);
+  std::vector<std::vector<sycl::event>> inFree(ringSlots), outFree(ringSlots);
+  for (int s = 0; s < ringSlots; s++) {
+    inSlot[s] = mallocStream<F>(chunkFlits, q, SOURCE_LOCATION);
+    outSlot[s] = mallocStream<F>(chunkFlits, q, SINK_LOCATION);
+  }
+
+  StreamEvents ev;
+  std::vector<sycl::event> prevSource, prevSink, copies;
+
+  for (int64_t c = 0; c < nchunks; c++) {
+    int s = (int)(c % ringSlots);
+    int64_t off = c * chunkFlits;
+    int64_t n = std::min(chunkFlits, nflits - off);
+
+    sycl::event copyIn = q.memcpy(inSlot[s], in + off, n * sizeof(F), inFree[s]);
+
+    std::vector<sycl::event> srcDeps = prevSource;
+    srcDeps.push_back(copyIn);
+    sycl::event source = submitSource<P>(q, inSlot[s], n, srcDeps);
+
+    std::vector<sycl::event> sinkDeps = prevSink;
+    sinkDeps.insert(sinkDeps.end(), outFree[s].begin(), outFree[s].end());
+    sycl::event sink = submitSink<P>(q, outSlot[s], n, sinkDeps);
+
+    sycl::event copyOut = q.memcpy(out + off, outSlot[s], n * sizeof(F), sink);
+
+    if (c == 0) {
+      ev.firstSource = source;
+    }
+    inFree[s] = {source};
+    outFree[s] = {copyOut};
+    prevSource = {source};
+    prevSink = {sink};
+    copies.push_back(copyOut);
+    ev.lastSource = source;
+    ev.lastSink = sink;
+    ev.done = copyOut;
+  }
+
+  sycl::event::wait(copies);
+  for (int s = 0; s < ringSlots; s++) {
+    sycl::free(inSlot[s], q);
+    sycl::free(outSlot[s], q);
+  }
+  return ev;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// Framed jobs
+//
+// streamFramed() runs a list of jobs of any length back to back
+// through a framed datapath.  Job j is jobs[j].nelems elements from
+// flit jobs[j].off of in to the same place in out; each is its own
+// scan, ended by eos, and the elements of out past its end are left
+// alone.  The whole nflits are staged through device memory in one
+// copy each way unless ZERO_COPY.
+//////////////////////////////////////////////////////////////////////////////
+
+struct FramedJob {
+  int64_t off;    // first flit
+  int64_t nelems; // elements, at least 1
+};
+
+template <typename P>
+StreamEvents streamFramed(sycl::queue &q, const typename P::Flit *in,
+                          typename P::Flit *out, int64_t nflits,
+                          const std::vector<FramedJob> &jobs) {
+  static_assert(P::framed, "jobs of any length need a framed datapath");
+  using F = typename P::Flit;
+  constexpr int W = P::width;
+
+#if ZERO_COPY
+  const F *din = in;
+  F *dout = out;
+  std::vector<sycl::event> copyIn;
+#else
+  F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+  F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+  // out too, for what the sink leaves alone
+  std::vector<sycl::event> copyIn = {q.memcpy(din, in, nflits * sizeof(F)),
+                                     q.memcpy(dout, out, nflits * sizeof(F))};
+#endif
+
+  StreamEvents ev;
+  std::vector<sycl::event> prevSource = copyIn, prevSink = copyIn;
+  for (size_t j = 0; j < jobs.size(); j++) {
+    int64_t n = (jobs[j].nelems + W - 1) / W;
+    int lastValid = (int)(jobs[j].nelems - (n - 1) * W);
+    sycl::event source = submitSource<P>(q, din + jobs[j].off, n, prevSource,
+                                         false, lastValid, true);
+    sycl::event sink = submitSink<P>(q, dout + jobs[j].off, n, prevSink);
+    if (j == 0) {
+      ev.firstSource = source;
+    }
+    prevSource = {source};
+    prevSink = {sink};
+    ev.lastSource = source;
+    ev.lastSink = sink;
+  }
+
+#if ZERO_COPY
+  ev.done = ev.lastSink;
+  ev.done.wait();
+#else
+  ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.lastSink);
+  ev.done.wait();
+  sycl::free(din, q);
+  sycl::free(dout, q);
+#endif
+  return ev;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Zero-copy streaming
+//
+// streamZeroCopy() runs the source and sink straight on host USM
+// memory (ZERO_COPY builds only): no device buffers and no copies.
+//////////////////////////////////////////////////////////////////////////////
+
+#if ZERO_COPY
+template <typename P>
+StreamEvents streamZeroCopy(sycl::queue &q, const typename P::Flit *in,
+                            typename P::Flit *out, int64_t nflits) {
+  StreamEvents ev;
+  ev.lastSink = submitSink<P>(q, out, nflits);
+  ev.firstSource = submitSource<P>(q, in, nflits);
+  ev.lastSource = ev.firstSource;
+  ev.done = ev.lastSink;
+  ev.done.wait();
+  return ev;
+}
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Replicated pipelines
+//
+// One scan pipeline uses a fraction of the fabric, so a build can
+// carry NUM_PIPELINES independent copies of the whole
+// {Input2Pipe, prefixSumA, prefixSumB, Pipe2Output} chain.
+// Replicated<P, L> is lane L of datapath P: the same datapath with its
+// own pipes and kernel names, so PipelineArray<P, N> is effectively an
+// array of N pipe sets indexed by lane.
+//
+// The host side takes a list of independent streams and splits them
+// across the lanes, longest first onto the least loaded lane, so the
+// lanes finish at about the same time.  On a lane, streams run back to
+// back; each restarts the scan, which needs a segmented datapath.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef NUM_PIPELINES
+#define NUM_PIPELINES 1
+#endif
+
+template <typename P, int L> struct Replicated : P {
+  using Pipes = PipesOf<Replicated, P>;
+  static constexpr int lane = L;
+};
+
+// one independent stream, in flits
+template <typename F> struct StreamJob {
+  const F *in;
+  F *out;
+  int64_t nflits;
+};
+
+template <typename P, int N = NUM_PIPELINES> struct PipelineArray {
+  static_assert(N >= 1, "need at least 1 pipeline");
+
+  using F = typename P::Flit;
+  template <int L> using Lane = Replicated<P, L>;
+
+  // call f(Lane<L>{}) for every lane L
+  template <typename Fn> static void forEach(Fn &&f) {
+    forEachImpl(f, std::make_integer_sequence<int, N>{});
+  }
+
+  // launch the scan kernels of every lane
+  static void launch(sycl::queue &q) {
+    forEach([&](auto lane) { submitPrefixSumAB<decltype(lane)>(q); });
+  }
+
+  // which streams (by index) go to which lane
+  static std::vector<std::vector<int>>
+  schedule(const std::vector<StreamJob<F>> &jobs) {
+    std::vector<int> order(jobs.size());
+    for (size_t j = 0; j < jobs.size(); j++) {
+      order[j] = (int)j;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return jobs[a].nflits > jobs[b].nflits;
+    });
+
+    std::vector<std::vector<int>> lanes(N);
+    std::vector<int64_t> load(N, 0);
+    for (int j : order) {
+      int l = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+      lanes[l].push_back(j);
+      load[l] += jobs[j].nflits;
+    }
+    return lanes;
+  }
+
+  // Runs every job to completion, the lanes concurrently.  Host
+  // memory should be USM host memory.  Returns the end of the last
+  // sink of every lane.
+  static std::vector<sycl::event> run(sycl::queue &q,
+                                      const std::vector<StreamJob<F>> &jobs) {
+    static_assert(P::segmented,
+                  "independent streams on one lane need a segmented datapath");
+
+    std::vector<std::vector<int>> lanes = schedule(jobs);
+    std::vector<sycl::event> done, ends;
+    std::vector<std::pair<F *, F *>> staging;
+
+    forEach([&](auto lane) {
+      using LP = decltype(lane);
+      const std::vector<int> &mine = lanes[LP::lane];
+      if (mine.empty()) {
+        return;
+      }
+
+      int64_t total = 0;
+      for (int j : mine) {
+        total += jobs[j].nflits;
+      }
+#if ZERO_COPY
+      F *din = nullptr;
+      F *dout = nullptr;
+#else
+      F *din = mallocStream<F>(total, q, SOURCE_LOCATION);
+      F *dout = mallocStream<F>(total, q, SINK_LOCATION);
+#endif
+      staging.push_back({din, dout});
+
+      // same-named kernels chained so the lane sees its streams in order
+      std::vector<sycl::event> prevSource, prevSink;
+      int64_t off = 0;
+      for (int j : mine) {
+        const StreamJob<F> &job = jobs[j];
+#if ZERO_COPY
+        const F *in = job.in;
+        F *out = job.out;
+        std::vector<sycl::event> srcDeps = prevSource;
+#else
+        const F *in = din + off;
+        F *out = dout + off;
+        std::vector<sycl::event> srcDeps = prevSource;
+        srcDeps.push_back(q.memcpy(din + off, job.in, job.nflits * sizeof(F)));
+#endif
+        prevSource = {submitSource<LP>(q, in, job.nflits, srcDeps, true)};
+        sycl::event sink = submitSink<LP>(q, out, job.nflits, prevSink);
+        prevSink = {sink};
+#if ZERO_COPY
+        ends.push_back(sink);
+#else
+        ends.push_back(q.memcpy(job.out, out, job.nflits * sizeof(F), sink));
+#endif
+        off += job.nflits;
+      }
+      done.push_back(prevSink[0]);
+    });
+
+    // every lane is submitted before waiting on any
+    sycl::event::wait(ends);
+
+    for (auto &s : staging) {
+      if (s.first) {
+        sycl::free(s.first, q);
+        sycl::free(s.second, q);
+      }
+    }
+    return done;
+  }
+
+private:
+  template <typename Fn, int... Ls>
+  static void forEachImpl(Fn &f, std::integer_sequence<int, Ls...>) {
+    (f(Lane<Ls>{}), ...);
+  }
+};
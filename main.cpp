@@ -1,3 +1,5 @@
+#include <chrono>
+
 #include <sycl/sycl.hpp>
 using namespace sycl;
 
@@ -9,6 +11,23 @@ using namespace sycl;
 #include <sycl/ext/intel/fpga_extensions.hpp>
 #endif
 
+// stream types, pipes, the scan kernels, host I/O and the service
+#include "aggregate.h"
+#include "bench.h"
+#include "checkpoint.h"
+#include "compact.h"
+#include "compress.h"
+#include "devices.h"
+#include "group_scan.h"
+#include "exact.h"
+#include "graph.h"
+#include "lanes.h"
+#include "model.h"
+#include "service.h"
+#include "tagged.h"
+#include "verify.h"
+#include "wide.h"
+
 //////////////////////////////////////////////////////////////////////////////
 // Kernel exception handler. Just rethrows exceptions and terminates.
 //////////////////////////////////////////////////////////////////////////////
@@ -27,137 +46,868 @@ static auto exception_handler = [](sycl::exception_list e_list) {
 };
 
 //////////////////////////////////////////////////////////////////////////////
-// Declare stream element and flit type
+// Choose the scan operator for the test run; e.g. -DSCAN_OP=MaxOp.
+// -DSCAN_OP=ExactSumOp sums in fixed point and rounds each output
+// once (see exact.h).  -DSCAN_OP=EwmaOp computes a moving average
+// (see scan.h).
+// -DSCAN_WINDOW=<elements> scans over a sliding window of that many
+// elements instead of from the start (see prefixSumBWindow()).
+// -DTAGGED_STREAMS=<n> runs the test as n streams interleaved flit by
+// flit over one pipeline, each scanned on its own (see tagged.h).
+// The test input is generated to suit the operator's value type.
+// -DSEGMENTED=1 runs a segmented scan over many short segments.
+//
+// -DMULTI_DATAPATH=1 builds uint16, uint64 and double datapaths into
+// one binary; pick one at runtime by naming it on the command line,
+// e.g. "mini_fpga double".
+//
+// -DSTREAM_CHUNK=<elements> streams the test through in chunks of that
+// many elements over a ring of STREAM_SLOTS device buffers, so copies
+// overlap the kernels (see host_io.h).  0 copies it in one batch.
+// -DZERO_COPY=1 instead streams straight out of and into host memory.
+// -DSERVICE=1 runs the source and sink as a persistent service and
+// feeds it the test as SERVICE_JOBS back-to-back jobs (see service.h).
+// -DNUM_PIPELINES=<n> builds n copies of the datapath and splits the
+// test into independent streams across them (see lanes.h); this needs
+// -DSEGMENTED=1 so each stream can restart the scan.
+// -DWIDE_LANES=<m> instead runs the test as one stream over m flit
+// lanes, m flits per cycle (see wide.h).
+// -DBENCH=1 builds the benchmark driver instead of the single test
+// run; see runBench().
+// -DVERIFY_MIRROR=1 checks the output bit for bit against a host model
+// of the kernels' own add order; -DVERIFY_ULPS=<n> instead accepts
+// floating-point sums within n epsilons per add of the sum of
+// magnitudes, so any add order passes with n = 2 (see sumClose() in
+// verify.h).  The default is an exact check against a plain scan.
+// -DTELEMETRY=1 counts active and stalled cycles of each stage and
+// prints them after the run (see telemetry.h).
+// -DDERIVED_DEPTHS=1 sizes each pipe from the stage latencies instead
+// of DEFAULT_PIPE_DEPTH (see "Pipe depths" in scan.h).
+// -DMERGED_AB_PIPE=1 links prefixSumA() to prefixSumB() with one pipe
+// of flits with their partial sums instead of DataPipe and SumPipe.
+// -DCOMPRESS=1 moves the stream to and from memory bit-packed (see
+// compress.h); the test input is then small numbers, i % 13.
+// -DFRAMED=1 builds framed datapaths and runs the test as jobs of
+// uneven length, most ending part way into a flit (see host_io.h).
+// -DCHECKPOINT=1, with -DFRAMED=1, runs the test as TEST_STREAMS
+// pieces of one stream, as uneven as the framed jobs, each resumed
+// from the last one's final carry (see checkpoint.h).
+// -DMULTI_DEVICE=1, with -DFRAMED=1, splits the test stream over all
+// the devices of the platform, DEVICE_PARTS parts (0: one per device),
+// and adds the parts' carries in on the devices (see devices.h).
+// -DGROUP_SCAN=1 runs the scan as one nd_range kernel instead of the
+// single_task kernels, for builds for CPU and GPU devices, which those
+// would crawl on (see group_scan.h).
+// -DHOST_MODEL=1 runs the test through a host model of the A/B graph
+// instead of the device, batch by batch, for checking large streams
+// fast; the output is the kernels' bit for bit (see model.h).
+// -DAGGREGATE=1 also feeds the input to a sliding-window sum and a
+// histogram, on the same read of it, and checks those too (see
+// aggregate.h).
+// -DCOMPACT=1 also compacts the test input to the elements TestKeep
+// selects, on the device, and checks that (see compact.h).
+// -DSTREAM_GRAPH=1 also runs the test input through a fused graph of
+// a filter, a scan and a reduction, and checks that (see graph.h);
+// it needs an unsegmented SCAN_OP over numbers.
+// -DSIMPLE_KERNEL=1 runs the test through prefixSumSimple() instead of
+// the A/B pair, to compare the two in the reports (see "make dse").
+// -DELEMENT=<type> and -DFLIT_BYTES=<n> set the element and flit size
+// of the test (see stream.h).
 //////////////////////////////////////////////////////////////////////////////
 
-// typedef double Element;
-typedef uint64_t Element;
-// typedef uint16_t Element;
+#ifndef SCAN_OP
+#define SCAN_OP SumOp
+#endif
 
-// handle multiple elements per cycle for concurrency
-#define STRM_WIDTH ((int)(64 / sizeof(Element)))
-typedef struct {
-  Element element[STRM_WIDTH];
-} Flit;
+#ifndef SEGMENTED
+#define SEGMENTED 0
+#endif
 
-//////////////////////////////////////////////////////////////////////////////
-// Declare Streaming Pipes
-//
-// Note: in SYCL, pipes are "types" with fixed reader and
-// writers. Pipes cannot be passed around as variables.
-//
-// Programmer must set minimum pipe depth to avoid deadlock. Compiler
-// will adjust depth for performance.
-//////////////////////////////////////////////////////////////////////////////
+#ifndef SCAN_WINDOW
+#define SCAN_WINDOW 0
+#endif
+
+#ifndef STREAM_CHUNK
+#define STREAM_CHUNK 0
+#endif
 
-#define DEFAULT_PIPE_DEPTH (4)
+#ifndef STREAM_SLOTS
+#define STREAM_SLOTS 2
+#endif
 
-// from data source to kernel pipeline
-using InPipe = ext::intel::pipe<class InPipe_id, Flit, DEFAULT_PIPE_DEPTH>;
-// from kernel to data sink
-using OutPipe = ext::intel::pipe<class outPipe_id, Flit, DEFAULT_PIPE_DEPTH>;
+#ifndef SERVICE_JOBS
+#define SERVICE_JOBS 64
+#endif
 
-// The above is all you need for prefixSumSimple();
-// The below are intermediate pipes between the 2 parts prefixSumA() and
-// prefixSumB();
-using DataPipe = ext::intel::pipe<class DataPipe_id, Flit, DEFAULT_PIPE_DEPTH>;
-using SumPipe = ext::intel::pipe<class SumPipe_id, Element, DEFAULT_PIPE_DEPTH>;
+#ifndef SIMPLE_KERNEL
+#define SIMPLE_KERNEL 0
+#endif
 
-//////////////////////////////////////////////////////////////////////////////
-// The kernel example computes the prefix sums on the input
-// stream. That is, to produce the output strea, the kernel replaces
-// each element by the sum of all previous elements including itself.
+#if NUM_PIPELINES > 1 && !SEGMENTED
+#error "NUM_PIPELINES > 1 needs SEGMENTED=1"
+#endif
+
+#if NUM_PIPELINES > 1 && SERVICE
+#error "NUM_PIPELINES > 1 and SERVICE are exclusive"
+#endif
+
+#if WIDE_LANES > 1 && (NUM_PIPELINES > 1 || SERVICE)
+#error "WIDE_LANES > 1 excludes NUM_PIPELINES > 1 and SERVICE"
+#endif
+
+#if COMPRESS && (WIDE_LANES > 1 || NUM_PIPELINES > 1 || SERVICE || BENCH)
+#error "COMPRESS runs the plain source/scan/sink datapath only"
+#endif
+
+#if FRAMED && (WIDE_LANES > 1 || NUM_PIPELINES > 1 || SERVICE || BENCH || \
+               COMPRESS || VERIFY_MIRROR)
+#error "FRAMED runs the plain source/scan/sink datapath, checked by verifyScan"
+#endif
+
+#if AGGREGATE && (WIDE_LANES > 1 || NUM_PIPELINES > 1 || SERVICE || BENCH || \
+                  COMPRESS || FRAMED || MULTI_DATAPATH)
+#error "AGGREGATE runs the plain source/scan/sink datapath of one integer type"
+#endif
+
+#if COMPACT && (SEGMENTED || FRAMED || BENCH)
+#error "COMPACT compacts the plain test stream after the scan test"
+#endif
+
+#if STREAM_GRAPH &&                                                          \
+    (SEGMENTED || NUM_PIPELINES > 1 || BENCH || GROUP_SCAN || HOST_MODEL ||   \
+     TELEMETRY)
+#error "STREAM_GRAPH runs its graph on the device after the scan test"
+#endif
+
+#if SCAN_WINDOW && (SEGMENTED || WIDE_LANES > 1 || SERVICE || BENCH || \
+                    COMPRESS || TELEMETRY || VERIFY_MIRROR)
+#error "SCAN_WINDOW runs the plain or framed A/B datapath, unsegmented"
+#endif
+
+#if CHECKPOINT && !FRAMED
+#error "CHECKPOINT needs FRAMED=1"
+#endif
+
+#if CHECKPOINT && (SCAN_WINDOW || TAGGED_STREAMS || TELEMETRY)
+#error "CHECKPOINT resumes the plain prefixSumB()"
+#endif
+
+#if MULTI_DEVICE && !FRAMED
+#error "MULTI_DEVICE needs FRAMED=1"
+#endif
+
+#if MULTI_DEVICE &&                                                          \
+    (SEGMENTED || ZERO_COPY || SCAN_WINDOW || WIDE_LANES > 1 ||               \
+     NUM_PIPELINES > 1 || SERVICE || BENCH || COMPRESS || AGGREGATE ||        \
+     TELEMETRY || CHECKPOINT || VERIFY_MIRROR)
+#error "MULTI_DEVICE runs the plain framed datapath on every device"
+#endif
+
+#if GROUP_SCAN && (FPGA_EMULATOR || FPGA_HARDWARE || FPGA_SIMULATOR)
+#error "GROUP_SCAN is the backend for CPU and GPU devices"
+#endif
+
+#if GROUP_SCAN &&                                                            \
+    (SEGMENTED || FRAMED || SCAN_WINDOW || TAGGED_STREAMS || WIDE_LANES > 1 || \
+     NUM_PIPELINES > 1 || SERVICE || BENCH || COMPRESS || AGGREGATE ||        \
+     COMPACT || TELEMETRY || MULTI_DEVICE || VERIFY_MIRROR)
+#error "GROUP_SCAN runs the plain scan, with no pipes"
+#endif
+
+#if HOST_MODEL &&                                                            \
+    (SCAN_WINDOW || TAGGED_STREAMS || WIDE_LANES > 1 || NUM_PIPELINES > 1 ||  \
+     SERVICE || BENCH || COMPRESS || AGGREGATE || COMPACT || TELEMETRY ||      \
+     CHECKPOINT || MULTI_DEVICE || GROUP_SCAN)
+#error "HOST_MODEL models the plain or framed A/B datapath"
+#endif
+
+#if TAGGED_STREAMS && (SEGMENTED || FRAMED || SCAN_WINDOW || WIDE_LANES > 1 || \
+                       NUM_PIPELINES > 1 || SERVICE || BENCH || COMPRESS || \
+                       AGGREGATE || TELEMETRY || VERIFY_MIRROR)
+#error "TAGGED_STREAMS runs the plain A/B datapath, unsegmented"
+#endif
+
+#if COMPRESS && (SEGMENTED || MULTI_DATAPATH)
+#error "COMPRESS needs an unsegmented integer datapath"
+#endif
+
+#if BENCH && (WIDE_LANES > 1 || NUM_PIPELINES > 1 || SERVICE)
+#error "BENCH runs the plain source/scan/sink datapaths only"
+#endif
+
+#if SIMPLE_KERNEL &&                                                         \
+    (SEGMENTED || FRAMED || SCAN_WINDOW || TAGGED_STREAMS || WIDE_LANES > 1 || \
+     NUM_PIPELINES > 1 || BENCH || AGGREGATE || TELEMETRY || CHECKPOINT ||    \
+     MULTI_DEVICE || GROUP_SCAN || HOST_MODEL || VERIFY_MIRROR)
+#error "SIMPLE_KERNEL scans the plain stream with prefixSumSimple()"
+#endif
+
+#ifndef VERIFY_MIRROR
+#define VERIFY_MIRROR 0
+#endif
+
+#ifndef VERIFY_ULPS
+#define VERIFY_ULPS 0
+#endif
+
+#if VERIFY_MIRROR && WIDE_LANES > 1
+#error "VERIFY_MIRROR models the A/B kernels, not the wide stream"
+#endif
+
+#ifndef BENCH_MIN_LEN
+#define BENCH_MIN_LEN (1 << 12)
+#endif
+
+#ifndef BENCH_WARMUP
+#define BENCH_WARMUP 2
+#endif
+
+#ifndef BENCH_REPEATS
+#define BENCH_REPEATS 10
+#endif
+
+#if SCAN_WINDOW
+template <typename P> using TestPath = Windowed<P, SCAN_WINDOW>;
+#elif TAGGED_STREAMS
+template <typename P> using TestPath = Tagged<P, TAGGED_STREAMS>;
+#elif CHECKPOINT
+template <typename P> using TestPath = Resumable<P>;
+#else
+template <typename P> using TestPath = P;
+#endif
+
+#if MULTI_DATAPATH
+using Paths = DatapathSet<TestPath<Datapath<SCAN_OP<uint16_t>, SEGMENTED>>,
+                          TestPath<Datapath<SCAN_OP<uint64_t>, SEGMENTED>>,
+                          TestPath<Datapath<SCAN_OP<double>, SEGMENTED>>>;
+#else
+using Paths = DatapathSet<TestPath<Datapath<SCAN_OP<Element>, SEGMENTED>>>;
+#endif
+
+template <typename V> struct TestInput {
+#if COMPRESS
+  static V at(int64_t i) { return (V)(i % 13); }
+#else
+  static V at(int64_t i) { return (V)i; }
+#endif
+};
+
+template <typename V> struct TestInput<Affine<V>> {
+  static Affine<V> at(int64_t i) { return {(V)(i % 3), (V)i}; }
+};
+
+// the compaction test keeps about 3 in 7 elements, irregularly
+struct TestKeep {
+  template <typename V> bool operator()(V x) const {
+    static_assert(std::is_arithmetic<V>::value, "TestKeep needs numbers");
+    return ((uint64_t)x * 2654435761u) % 7 < 3;
+  }
+};
+
+// The graph of the graph test over P's elements: the elements TestKeep
+// selects, their running sum, and the largest of that, as one framed
+// job.
+template <typename P>
+using TestGraph =
+    Graph<Datapath<SumOp<typename P::Value>, false, typename P::Scan,
+                   P::width, true>,
+          FilterStage<TestKeep>, ScanStage<SumOp<typename P::Value>>,
+          ReduceStage<MaxOp<typename P::Value>>>;
+
+// segment heads at irregular spacing, from 1 to a few hundred elements
+bool testHead(int64_t i) { return (i == 0) || ((i * 2654435761u) % 251 < 3); }
+
+#define STRM_LEN (1 << 24)
+
+// independent streams for the replicated pipelines, 4 per pipeline,
+// or framed jobs
+#define TEST_STREAMS (4 * NUM_PIPELINES)
+
+// The first flit of each of TEST_STREAMS streams over nflits flits,
+// plus nflits at the end.  Stream k is about k+1 units long, so the
+// scheduler has uneven work to balance.
+std::vector<int64_t> testStreamStarts(int64_t nflits) {
+  int64_t units = (int64_t)TEST_STREAMS * (TEST_STREAMS + 1) / 2;
+  std::vector<int64_t> starts;
+  for (int64_t k = 0; k <= TEST_STREAMS; k++) {
+    starts.push_back(nflits * (k * (k + 1) / 2) / units);
+  }
+  return starts;
+}
+
+// The framed test jobs over nflits flits: TEST_STREAMS jobs from
+// testStreamStarts(), job k short of the end of its flits by some
+// elements, so its last flit has 1 + 3k % W valid.
+template <typename P> std::vector<FramedJob> testJobs(int64_t nflits) {
+  constexpr int W = P::width;
+  std::vector<int64_t> starts = testStreamStarts(nflits);
+  std::vector<FramedJob> jobs;
+  for (int k = 0; k < TEST_STREAMS; k++) {
+    int64_t n = starts[k + 1] - starts[k];
+    jobs.push_back({starts[k], (n - 1) * W + 1 + (3 * k) % W});
+  }
+  return jobs;
+}
+
+// The elements of the jobs of buf back to back, with their heads, as
+// the one stream the resumed test runs them as; the last flit is
+// padded with zeros.
+template <typename P>
+std::vector<typename P::Flit> packJobs(const typename P::Flit *buf,
+                                       const std::vector<FramedJob> &jobs) {
+  using OpFlit = typename P::Flit;
+  constexpr int W = P::width;
+  int64_t n = 0;
+  for (const FramedJob &job : jobs) {
+    n += job.nelems;
+  }
+  std::vector<OpFlit> packed((n + W - 1) / W, OpFlit{});
+  int64_t i = 0;
+  for (const FramedJob &job : jobs) {
+    for (int64_t j = 0; j < job.nelems; j++, i++) {
+      const OpFlit &from = buf[job.off + j / W];
+      packed[i / W].element[i % W] = from.element[j % W];
+      if constexpr (P::segmented) {
+        if ((from.heads >> (j % W)) & 1) {
+          packed[i / W].heads |= (decltype(from.heads))1 << (i % W);
+        }
+      }
+    }
+  }
+  return packed;
+}
+
+// The tags of the tagged test: runs of 1 to 4 flits of a stream at a
+// time, for back-to-back flits of one id, the streams picked in an
+// irregular order out of TAGGED_STREAMS; each restarts at its first.
+std::vector<StreamTag> testTags(int64_t nflits) {
+  std::vector<StreamTag> tags(nflits);
+  std::vector<bool> seen(std::max(TAGGED_STREAMS, 1), false);
+  for (int64_t f = 0; f < nflits;) {
+    uint64_t h = (uint64_t)f * 2654435761u;
+    uint32_t id = (uint32_t)((h >> 8) % std::max(TAGGED_STREAMS, 1));
+    for (int64_t end = std::min<int64_t>(nflits, f + 1 + (h >> 4) % 4);
+         f < end; f++) {
+      tags[f] = {id, !seen[id]};
+      seen[id] = true;
+    }
+  }
+  return tags;
+}
+
+// the first n test elements into in, and zeros into out, a flit at a
+// time over the host threads
+template <typename P>
+void fillTest(typename P::Flit *in, typename P::Flit *out, int64_t n) {
+  using Value = typename P::Value;
+  constexpr int W = P::width;
+  parallelFor(n / W, [&](int, int64_t begin, int64_t end) {
+    for (int64_t f = begin; f < end; f++) {
+      int64_t i = f * W;
+      for (int j = 0; j < W; j++) {
+        in[f].element[j] = TestInput<Value>::at(i + j);
+        out[f].element[j] = Value{};
+      }
+      if constexpr (P::segmented) {
+        in[f].heads = 0;
+        for (int j = 0; j < W; j++) {
+          if (testHead(i + j)) {
+            in[f].heads |= (decltype(in->heads))1 << j;
+          }
+        }
+      }
+    }
+  });
+}
+
+///////////////////////////////////////////////////////////////////
 //
-// The kernel is writen as a function template so it is reusable with
-// different input and output pipe connections.
+// runTest(): stream STRM_LEN test elements through datapath P and
+// check the result.
 //
-// Stream kernel never terminates; this is unusal for normal
-// compute-offload kernels.
-//////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////
+template <typename P> int runTest(queue &q) {
+  using Op [[maybe_unused]] = typename P::Op;
+  using Value = typename P::Value;
+  using OpFlit = typename P::Flit;
+  using HostAlloc = usm_allocator<OpFlit, usm::alloc::host>;
+  constexpr int OP_WIDTH = P::width;
+
+  double elapseTime = 0.0;
+  double wallTime = 0.0;
+#if COMPRESS
+  int64_t inWords = 0, outWords = 0; // packed 64-byte words moved
+#endif
+#if CHECKPOINT
+  using Acc = typename P::Acc;
+  Acc carry = AccumOf<Op>::Op::identity(); // of the last piece
+#endif
+#if TAGGED_STREAMS
+  std::vector<StreamTag> tags = testTags(STRM_LEN / OP_WIDTH);
+#endif
+#if AGGREGATE
+  using Agg = Aggregates<P>;
+  std::vector<OpFlit, HostAlloc> windowBuf(STRM_LEN / OP_WIDTH, HostAlloc(q));
+  std::vector<uint64_t> bins(HIST_BINS);
+  Value total{};
+#endif
+
+  ////////////////////////////////////////////
+  // Set up test input and out buffers
+  ////////////////////////////////////////////
+
+  // allocate and initialize buffers in (pinned) host memory
+  std::vector<OpFlit, HostAlloc> idataBuf(2 * STRM_LEN / OP_WIDTH,
+                                          HostAlloc(q));
+  std::vector<OpFlit, HostAlloc> odataBuf(2 * STRM_LEN / OP_WIDTH,
+                                          HostAlloc(q));
+
+  fillTest<P>(idataBuf.data(), odataBuf.data(), STRM_LEN);
+
+  ////////////////////////////////////////////
+  // The fun stuff
+  ////////////////////////////////////////////
+
+#if TELEMETRY && NUM_PIPELINES == 1 && WIDE_LANES == 1 && !SERVICE && \
+    !COMPRESS && !AGGREGATE
+  std::vector<StageStats> statsBefore = readTelemetry<P>(q);
+#endif
+
+  try {
+    // The processing kernels are already running; see main().  The
+    // source and sink kernels are launched per chunk, and device
+    // buffers are allocated, filled and drained by streamChunked().
+    int64_t nflits = STRM_LEN / OP_WIDTH;
+    int64_t chunkFlits = (STREAM_CHUNK > 0) ? STREAM_CHUNK / OP_WIDTH : nflits;
 
-// In prefixSumSimple(), each iteration of the outermost while-loop
-// depends on the final sum of the previous iteration.  To achieve the
-// requested II=1, all elements in a flit must be summed together and
-// added to the running sum in 1 cyc, leading to a low clock
-// frequency.  The compiler cannot produce II=1 schedule for
-// double-type Element since combinational cascading of FADD is not
-// supported.
-
-template <typename TInPipe, typename TOutPipe> void prefixSumSimple() {
-  Element prefixSum = 0; // this is state carried across time
-
-  [[intel::initiation_interval(1)]] // insist II=1 schedule
-  while (1) {
-    Flit iflit = TInPipe::read(); // get this iteration's input
-    Flit oflit;                   // output flit to be prepared
-
-    // need to unroll to initiate on a new flit each cycle
-#pragma unroll
-    for (int64_t i = 0; i < STRM_WIDTH; i++) {
-      prefixSum += iflit.element[i];
-      oflit.element[i] = prefixSum;
+#if SERVICE
+    // The service kernels take jobs of nflits/SERVICE_JOBS flits back
+    // to back.  Unless they can reach host memory, stage the stream
+    // through device memory outside of the timed part.
+    (void)chunkFlits;
+    const OpFlit *in = idataBuf.data();
+    OpFlit *out = odataBuf.data();
+#if !ZERO_COPY
+    OpFlit *din = mallocStream<OpFlit>(nflits, q, SOURCE_LOCATION);
+    OpFlit *dout = mallocStream<OpFlit>(nflits, q, SINK_LOCATION);
+    q.memcpy(din, in, nflits * sizeof(OpFlit)).wait();
+    in = din;
+    out = dout;
+#endif
+    ScanService<P> service(q);
+    int64_t jobFlits = (nflits + SERVICE_JOBS - 1) / SERVICE_JOBS;
+
+    auto wallStart = std::chrono::steady_clock::now();
+    int inFlight = 0;
+    uint32_t id = 0;
+    for (int64_t off = 0; off < nflits; off += jobFlits, id++) {
+      // the done pipe must be drained for the service to keep going
+      if (inFlight == SERVICE_CMD_DEPTH) {
+        service.waitDone();
+        inFlight--;
+      }
+      int64_t n = std::min(jobFlits, nflits - off);
+      service.submit({in + off, out + off, n, kJobContinue, id});
+      inFlight++;
+    }
+    while (inFlight > 0) {
+      service.waitDone();
+      inFlight--;
+    }
+    wallTime = std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - wallStart)
+                   .count();
+    service.stop();
+
+#if !ZERO_COPY
+    q.memcpy(odataBuf.data(), dout, nflits * sizeof(OpFlit)).wait();
+    free(din, q);
+    free(dout, q);
+#endif
+    // no per-job kernel events in service mode
+    elapseTime = wallTime;
+#elif NUM_PIPELINES > 1
+    (void)chunkFlits;
+    std::vector<int64_t> starts = testStreamStarts(nflits);
+    std::vector<StreamJob<OpFlit>> jobs;
+    for (int k = 0; k < TEST_STREAMS; k++) {
+      jobs.push_back({idataBuf.data() + starts[k], odataBuf.data() + starts[k],
+                      starts[k + 1] - starts[k]});
+    }
+
+    auto wallStart = std::chrono::steady_clock::now();
+    PipelineArray<P>::run(q, jobs);
+    wallTime = std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - wallStart)
+                   .count();
+    // the lanes overlap; there is no single kernel span to report
+    elapseTime = wallTime;
+#elif HOST_MODEL
+    // the launches streamFramed() or streamChunked() would make, on
+    // the model
+    auto wallStart = std::chrono::steady_clock::now();
+#if FRAMED
+    (void)chunkFlits;
+    for (const FramedJob &job : testJobs<P>(nflits)) {
+      int64_t n = (job.nelems + OP_WIDTH - 1) / OP_WIDTH;
+      hostModel<P>().run(idataBuf.data() + job.off,
+                         odataBuf.data() + job.off, n, false,
+                         (int)(job.nelems - (n - 1) * OP_WIDTH), true);
     }
+#else
+    for (int64_t off = 0; off < nflits; off += chunkFlits) {
+      hostModel<P>().run(idataBuf.data() + off, odataBuf.data() + off,
+                         std::min(chunkFlits, nflits - off));
+    }
+#endif
+    wallTime = std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - wallStart)
+                   .count();
+    // no kernels ran
+    elapseTime = wallTime;
+#elif MULTI_DEVICE
+    (void)chunkFlits;
+    std::vector<queue> &queues = deviceQueues(q, exception_handler);
+    auto wallStart = std::chrono::steady_clock::now();
+    int nparts = MultiDevice<P>::run(queues, idataBuf.data(), odataBuf.data(),
+                                     STRM_LEN, DEVICE_PARTS);
+    wallTime = std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - wallStart)
+                   .count();
+    std::cout << "Parts: " << nparts << " over " << queues.size()
+              << " devices" << std::endl;
+    // the devices overlap; there is no single kernel span to report
+    elapseTime = wallTime;
+#else
+    auto wallStart = std::chrono::steady_clock::now();
+#if WIDE_LANES > 1
+    (void)chunkFlits;
+    StreamEvents ev =
+        WideStream<P>::run(q, idataBuf.data(), odataBuf.data(), nflits);
+#elif COMPRESS
+    (void)chunkFlits;
+    StreamEvents ev = streamPacked<P>(q, idataBuf.data(), odataBuf.data(),
+                                      nflits, inWords, outWords);
+#elif AGGREGATE
+    (void)chunkFlits;
+    StreamEvents ev = Agg::run(q, idataBuf.data(), odataBuf.data(),
+                               windowBuf.data(), bins.data(), &total, nflits);
+#elif GROUP_SCAN
+    (void)chunkFlits;
+    StreamEvents ev =
+        streamGroupScan<P>(q, idataBuf.data(), odataBuf.data(), nflits);
+#elif TAGGED_STREAMS
+    (void)chunkFlits;
+    StreamEvents ev = streamTagged<P>(q, idataBuf.data(), tags.data(),
+                                      odataBuf.data(), nflits);
+#elif CHECKPOINT
+    // one stream in pieces, each seeded with the last one's carry: the
+    // first through the host, as from another launch, the rest queued
+    // back to back on the device.  The pieces are the framed test
+    // jobs, so most end part way into a flit and the carry crosses
+    // its padding.
+    (void)chunkFlits;
+    std::vector<FramedJob> pieces = testJobs<P>(nflits);
+    StreamEvents ev, rest;
+    carry = streamResumed<P>(q, idataBuf.data(), odataBuf.data(),
+                             pieces[0].nelems, carry, &ev);
+    pieces.erase(pieces.begin());
+    if (!pieces.empty()) {
+      carry = streamResumedJobs<P>(q, idataBuf.data(), odataBuf.data(),
+                                   nflits, pieces, carry, &rest);
+      ev.lastSink = rest.lastSink;
+    }
+#elif FRAMED
+    (void)chunkFlits;
+    StreamEvents ev = streamFramed<P>(q, idataBuf.data(), odataBuf.data(),
+                                      nflits, testJobs<P>(nflits));
+#elif ZERO_COPY
+    (void)chunkFlits;
+    StreamEvents ev =
+        streamZeroCopy<P>(q, idataBuf.data(), odataBuf.data(), nflits);
+#else
+    StreamEvents ev = streamChunked<P>(q, idataBuf.data(), odataBuf.data(),
+                                       nflits, chunkFlits, STREAM_SLOTS);
+#endif
+    wallTime = std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - wallStart)
+                   .count();
+
+    // kernel time is from the start of the first source to the end of
+    // the last sink, so it covers the whole pipeline
+    elapseTime =
+        ev.lastSink
+            .template get_profiling_info<info::event_profiling::command_end>() -
+        ev.firstSource.template get_profiling_info<
+            info::event_profiling::command_start>();
+#endif
 
-    TOutPipe::write(oflit); // push this iteration's output
+  } catch (std::exception const &e) {
+    std::cerr << "Exception! " << e.what() << std::endl;
+    std::terminate();
   }
-}
 
-// In this version, streaming prefix sum is computed in 2 kernels, A
-// and B.  prefixSumA() computes the sum across the Elements of the
-// same flit.  There is no dependency across iterations so high
-// frequency is achieviable for II=1 by pipelining. prefixSumA()
-// forwards both the flit and its partial sum to prefixSumB().
-// prefixSumB() computes the prefixSum of each element of a flit based
-// of the running sum from the last iteration. In this case, each
-// iteration need to update prefixSum=prefixSum+partialSum for the
-// next iteration.  Even if Element is double, II can still be 1, and
-// the clock period is lower bounded by performing 1 FADD (expect
-// about 100MHz).  The logic to map from iflit to oflit is substantial
-// and must perform at least lg(STRM_WIDTH) deep in dependent FADDs,
-// but this logic without depedence across iterations is trivially
-// pipelinable.
-
-template <typename TInPipe, typename TSumPipe, typename TDataPipe>
-void prefixSumA() {
-  [[intel::initiation_interval(1)]] // insist II=1 schedule
-  while (1) {
-    Flit iflit = TInPipe::read(); // get this iteration's flit
-    Element partialSum = 0;
-
-    // need to unroll to initiate on a new flit each cycle
-#pragma unroll
-    for (int64_t i = 0; i < STRM_WIDTH; i++) {
-      partialSum += iflit.element[i];
+#if TELEMETRY && NUM_PIPELINES == 1 && WIDE_LANES == 1 && !SERVICE && \
+    !COMPRESS && !AGGREGATE
+  // the counts of A and B as of when they ran dry after the run; the
+  // replicated, wide, service and aggregated kernels are not reported
+  std::vector<StageStats> statsAfter =
+      waitTelemetry<P>(q, statsBefore, STRM_LEN / OP_WIDTH);
+  using Depths = typename P::Depths;
+  std::cout << "pipe depths: in " << Depths::in << ", data " << Depths::data
+            << ", sum " << Depths::sum << ", out " << Depths::out
+            << std::endl;
+  reportTelemetry(statsBefore, statsAfter);
+#endif
+
+  // the results are back in host memory
+  auto &idataPtr = idataBuf;
+  auto &odataPtr = odataBuf;
+
+#if 0
+  for (int i = 0; i < 16; i++) {
+    // look at a few outputs
+    std::cout << odataPtr[i / OP_WIDTH].element[i % OP_WIDTH] << std::endl;
+  }
+#endif
+
+#if FRAMED && !CHECKPOINT && !MULTI_DEVICE
+  // each job is its own scan, and the sink leaves the elements past its
+  // end alone
+  for (const FramedJob &job : testJobs<P>(STRM_LEN / OP_WIDTH)) {
+    const OpFlit *in = idataPtr.data() + job.off;
+    const OpFlit *out = odataPtr.data() + job.off;
+#if SCAN_WINDOW
+    int64_t bad = verifyWindowScan<P>(in, out, job.nelems, SCAN_WINDOW);
+#else
+    int64_t bad = verifyScan<P>(in, out, job.nelems, {},
+                                AccumOf<Op>::Op::identity(), VERIFY_ULPS);
+#endif
+    for (int64_t i = job.nelems; bad < 0 && i % OP_WIDTH != 0; i++) {
+      if (!(out[i / OP_WIDTH].element[i % OP_WIDTH] == Value{})) {
+        bad = i;
+      }
     }
+    if (bad >= 0) {
+      std::cout << "Sum incorrect at element " << job.off * OP_WIDTH + bad
+                << "." << std::endl;
+      return 1;
+    }
+  }
+  int64_t bad = -1;
+#elif CHECKPOINT
+  // the pieces are one stream, their elements back to back; the sink
+  // leaves the tails of their last flits alone
+  std::vector<FramedJob> pieces = testJobs<P>(STRM_LEN / OP_WIDTH);
+  for (const FramedJob &piece : pieces) {
+    const OpFlit *out = odataPtr.data() + piece.off;
+    for (int64_t i = piece.nelems; i % OP_WIDTH != 0; i++) {
+      if (!(out[i / OP_WIDTH].element[i % OP_WIDTH] == Value{})) {
+        std::cout << "Sum incorrect at element " << piece.off * OP_WIDTH + i
+                  << "." << std::endl;
+        return 1;
+      }
+    }
+  }
+  int64_t resumedLen = 0;
+  for (const FramedJob &piece : pieces) {
+    resumedLen += piece.nelems;
+  }
+  std::vector<OpFlit> resumedIn = packJobs<P>(idataPtr.data(), pieces);
+  std::vector<OpFlit> resumedOut = packJobs<P>(odataPtr.data(), pieces);
+  // bad is an index into the resumed stream
+  int64_t bad = verifyScan<P>(resumedIn.data(), resumedOut.data(), resumedLen,
+                              {}, AccumOf<Op>::Op::identity(), VERIFY_ULPS);
+#else
+#if NUM_PIPELINES > 1
+  // each stream starts over
+  std::vector<int64_t> starts = testStreamStarts(STRM_LEN / OP_WIDTH);
+#else
+  std::vector<int64_t> starts;
+#endif
+#if TAGGED_STREAMS
+  (void)starts;
+  int64_t bad = verifyTagged<P>(idataPtr.data(), tags.data(), odataPtr.data(),
+                                STRM_LEN / OP_WIDTH);
+#elif SCAN_WINDOW
+  (void)starts;
+  int64_t bad = verifyWindowScan<P>(idataPtr.data(), odataPtr.data(),
+                                    STRM_LEN, SCAN_WINDOW);
+#elif VERIFY_MIRROR
+  int64_t bad = verifyMirror<P>(idataPtr.data(), odataPtr.data(),
+                                STRM_LEN / OP_WIDTH, starts,
+                                AccumOf<Op>::Op::identity());
+#else
+  int64_t bad = verifyScan<P>(idataPtr.data(), odataPtr.data(), STRM_LEN,
+                              starts, AccumOf<Op>::Op::identity(),
+                              VERIFY_ULPS);
+#endif
+#endif
+  if (bad >= 0) {
+    std::cout << "Sum incorrect at element " << bad << "." << std::endl;
+    return 1;
+  }
 
-    TSumPipe::write(partialSum); // forward sum of this flit
-    TDataPipe::write(iflit);     // forward flit
+  std::cout << "Sum is correct." << std::endl;
+#if CHECKPOINT
+  if (!(AccumOf<Op>::lower(carry) ==
+        resumedOut[(resumedLen - 1) / OP_WIDTH]
+            .element[(resumedLen - 1) % OP_WIDTH])) {
+    std::cout << "Final carry incorrect." << std::endl;
+    return 1;
   }
+  std::cout << "Resumed " << TEST_STREAMS << " pieces; final carry is "
+            << "correct." << std::endl;
+#endif
+#if AGGREGATE
+  bad = Agg::verifyWindow(idataPtr.data(), windowBuf.data(),
+                          STRM_LEN / OP_WIDTH);
+  if (bad >= 0) {
+    std::cout << "Window sum incorrect at element " << bad << "."
+              << std::endl;
+    return 1;
+  }
+  if (bins != Agg::hostHistogram(idataPtr.data(), STRM_LEN / OP_WIDTH) ||
+      total != Agg::hostTotal(idataPtr.data(), STRM_LEN / OP_WIDTH)) {
+    std::cout << "Histogram or total incorrect." << std::endl;
+    return 1;
+  }
+  std::cout << "Window sums, histogram and total are correct." << std::endl;
+#endif
+
+#if COMPACT
+  // the same input again, compacted
+  using Compact = Compactor<P, TestKeep>;
+  std::vector<OpFlit, HostAlloc> keptBuf(STRM_LEN / OP_WIDTH, HostAlloc(q));
+  int64_t kept = 0;
+  StreamEvents cev = Compact::run(q, idataPtr.data(), keptBuf.data(),
+                                  STRM_LEN / OP_WIDTH, kept);
+  bad = Compact::verify(idataPtr.data(), keptBuf.data(), STRM_LEN / OP_WIDTH,
+                        kept);
+  if (bad >= 0) {
+    std::cout << "Compaction incorrect at output element " << bad << "."
+              << std::endl;
+    return 1;
+  }
+  double compactTime =
+      cev.lastSink
+          .template get_profiling_info<info::event_profiling::command_end>() -
+      cev.firstSource
+          .template get_profiling_info<info::event_profiling::command_start>();
+  std::cout << "Compaction is correct: kept " << kept << " of " << STRM_LEN
+            << " elements in " << compactTime / 1E9 * 1E3 << " ms"
+            << std::endl;
+#endif
+
+#if STREAM_GRAPH
+  // the same input again, through the graph, ending part way into a
+  // flit
+  static_assert(std::is_arithmetic<Value>::value,
+                "STREAM_GRAPH filters and sums numbers, not SCAN_OP's "
+                "elements");
+  using TG = TestGraph<P>;
+  using Sum = SumOp<Value>;
+  using Max = MaxOp<Value>;
+  int64_t graphElems = STRM_LEN - 3;
+  std::vector<OpFlit, HostAlloc> graphBuf(STRM_LEN / OP_WIDTH, HostAlloc(q));
+  Value graphMax{};
+  StreamEvents gev = streamGraph<TG>(q, idataPtr.data(), graphBuf.data(),
+                                     graphElems, &graphMax);
+  Value sum = Sum::identity(), largest = Max::identity();
+  for (int64_t i = 0; i < graphElems; i++) {
+    Value x = idataPtr[i / OP_WIDTH].element[i % OP_WIDTH];
+    sum = Sum::apply(sum, TestKeep{}(x) ? x : Sum::identity());
+    largest = Max::apply(largest, sum);
+    if (!(graphBuf[i / OP_WIDTH].element[i % OP_WIDTH] == sum)) {
+      std::cout << "Graph incorrect at element " << i << "." << std::endl;
+      return 1;
+    }
+  }
+  if (!(graphMax == largest)) {
+    std::cout << "Graph reduction incorrect." << std::endl;
+    return 1;
+  }
+  double graphTime =
+      gev.lastSink
+          .template get_profiling_info<info::event_profiling::command_end>() -
+      gev.firstSource
+          .template get_profiling_info<info::event_profiling::command_start>();
+  std::cout << "Graph is correct: filter, scan and max of " << graphElems
+            << " elements in " << graphTime / 1E9 * 1E3 << " ms"
+            << std::endl;
+#endif
+  std::cout << elapseTime / 1E9 * 1E3 << " ms" << std::endl;
+  std::cout << "Streaming BW: "
+            << sizeof(Value) * (STRM_LEN / 1E9) / (elapseTime / 1E9)
+            << " GB/sec" << std::endl;
+  std::cout << "End-to-end: " << wallTime / 1E9 * 1E3 << " ms, "
+            << sizeof(Value) * (STRM_LEN / 1E9) / (wallTime / 1E9)
+            << " GB/sec" << std::endl;
+#if COMPRESS
+  // the bandwidths above are of the unpacked stream
+  std::cout << "Packed: input " << 100.0 * inWords * OP_WIDTH / STRM_LEN
+            << "%, output " << 100.0 * outWords * OP_WIDTH / STRM_LEN
+            << "% of raw" << std::endl;
+#endif
+
+  return 0;
 }
 
-template <typename TSumPipe, typename TDataPipe, typename TOutPipe>
-void prefixSumB() {
-  Element sumSoFar = 0; // this is state carried across time
-
-  [[intel::initiation_interval(1)]] // insist II=1 schedule
-  while (1) {
-    // get this iteration's inputs (partial sum and flit)
-    Flit iflit = TDataPipe::read();
-    Element partialSum =
-        TSumPipe::read(); // precomputed partial Sum of this flit
-
-    Flit oflit;
-    Element prefixSum = sumSoFar;
-
-    // need to unroll to initiate on a new flit each cycle
-#pragma unroll
-    for (int64_t i = 0; i < STRM_WIDTH; i++) {
-      prefixSum += iflit.element[i];
-      oflit.element[i] = prefixSum;
+///////////////////////////////////////////////////////////////////
+//
+// runBench(): for stream lengths from BENCH_MIN_LEN to STRM_LEN
+// elements, by factors of 4, stream through datapath P with the A/B
+// kernels and (for unsegmented P) prefixSumSimple(), BENCH_WARMUP
+// times and then BENCH_REPEATS timed times, and add a row per length
+// and variant to report.
+//
+///////////////////////////////////////////////////////////////////
+template <typename P> void runBench(queue &q, BenchReport &report) {
+  using Value = typename P::Value;
+  using OpFlit = typename P::Flit;
+  using HostAlloc = usm_allocator<OpFlit, usm::alloc::host>;
+  constexpr int OP_WIDTH = P::width;
+
+  std::vector<OpFlit, HostAlloc> idataBuf(STRM_LEN / OP_WIDTH, HostAlloc(q));
+  std::vector<OpFlit, HostAlloc> odataBuf(STRM_LEN / OP_WIDTH, HostAlloc(q));
+  fillTest<P>(idataBuf.data(), odataBuf.data(), STRM_LEN);
+
+  std::string name = Paths::typeNameOf<P>();
+
+  auto benchVariant = [&](auto v, const char *variant) {
+    using V = decltype(v);
+    // The scan kernels carry their state from one run to the next,
+    // and every run starts where the last one ended.  The carry is
+    // followed on the host, in the accumulator type: the last output
+    // is only its lowered value.
+    static typename P::Acc carry = AccumOf<typename P::Op>::Op::identity();
+    for (int64_t len = BENCH_MIN_LEN; len <= STRM_LEN; len *= 4) {
+      int64_t nflits = len / OP_WIDTH;
+      int64_t chunkFlits =
+          (STREAM_CHUNK > 0) ? STREAM_CHUNK / OP_WIDTH : nflits;
+      bool correct = true;
+      BenchSamples samples = benchStream<V>(
+          q, idataBuf.data(), odataBuf.data(), nflits, chunkFlits,
+          STREAM_SLOTS, BENCH_WARMUP, BENCH_REPEATS, [&](int r) {
+            if (r == BENCH_REPEATS - 1) {
+#if VERIFY_MIRROR
+              correct = verifyMirror<V>(idataBuf.data(), odataBuf.data(),
+                                        nflits, {}, carry) < 0;
+#else
+              correct = verifyScan<V>(idataBuf.data(), odataBuf.data(),
+                                      len, {}, carry, VERIFY_ULPS) < 0;
+#endif
+            }
+            carry = scanCarry<V>(idataBuf.data(), nflits, carry);
+          });
+      report.add(name, variant, len, len * (int64_t)sizeof(Value), samples,
+                 correct);
     }
+  };
 
-    sumSoFar += partialSum; // for next iterations
-    TOutPipe::write(oflit); // forward flit
+  benchVariant(P{}, "ab");
+  if constexpr (!P::segmented) {
+    benchVariant(SimpleVariant<P>{}, "simple");
   }
 }
 
@@ -181,8 +931,6 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char **argv) {
   auto selector = default_selector_v;
 #endif
 
-  double elapseTime = 0.0;
-
   // initialize SCYL device queue
   queue q(selector, exception_handler, property::queue::enable_profiling{});
 
@@ -196,6 +944,14 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char **argv) {
       std::terminate();
     }
 
+#if ZERO_COPY
+    if (!device.has(aspect::usm_host_allocations)) {
+      std::cerr << "ERROR: The selected device does not support USM host"
+                << " allocations\n";
+      std::terminate();
+    }
+#endif
+
     std::cout << "Running on device: "
               << device.get_info<info::device::name>().c_str() << std::endl;
   }
@@ -204,124 +960,67 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char **argv) {
   // End SYCL setup boiler plate
   ////////////////////////////////////////////
 
-  ////////////////////////////////////////////
-  // Set up test input and out buffers
-  ////////////////////////////////////////////
-
-#define STRM_LEN (1 << 24)
-
-  // allocate and initialize buffers in host memory
-  std::vector<Flit> idataBuf(2 * STRM_LEN / STRM_WIDTH);
-  std::vector<Flit> odataBuf(2 * STRM_LEN / STRM_WIDTH);
-
-  for (int64_t i = 0; i < STRM_LEN; i++) {
-    idataBuf[i / STRM_WIDTH].element[i % STRM_WIDTH] = i;
-    odataBuf[i / STRM_WIDTH].element[i % STRM_WIDTH] = 0x0;
-  }
-
-  // allocate device buffers
-  sycl::buffer<Flit, 1> idataBuf_usm(idataBuf);
-  sycl::buffer<Flit, 1> odataBuf_usm(odataBuf);
-
-  ////////////////////////////////////////////
-  // The fun stuff
-  ////////////////////////////////////////////
-
-  try {
-    //
-    // Launching kernels back-to-front because we are using the source
-    // stage for timing.
-    //
-
-    // Launch a kernel that copies output data from a pipe
-    // to USM memory for host to read
-    event eventSink = q.submit([&](handler &h) {
-      sycl::accessor obufPtr(odataBuf_usm, h, sycl::write_only);
-      h.single_task<class Pipe2Output>([=]() {
-        [[intel::initiation_interval(1)]] // insist II=1 schedule
-        for (int64_t i = 0; i < STRM_LEN; i += STRM_WIDTH) {
-          Flit flit = OutPipe::read();
-          obufPtr[i / STRM_WIDTH] = flit;
-        }
-      });
-    });
-
-    // Launch processing kernels to compute prefix sum on the data
-    // stream.  You can try two different ways to compute the prefix
-    // sum.
-#if 0
-    q.submit([&](handler &h) {
-      h.single_task<class PrefixSum>([=]() {
-	prefixSumSimple<InPipe, OutPipe>();
-      });
-    });
+  // Launch processing kernels to compute prefix sum on the data
+  // stream, once for every datapath of the build; they never
+  // terminate.  You can try two different ways to compute the prefix
+  // sum.
+  Paths::forEach([&](auto p) {
+    using P [[maybe_unused]] = decltype(p);
+#if BENCH
+    submitPrefixSumAB<P>(q);
+    if constexpr (!P::segmented) {
+      submitPrefixSumSimple<SimpleVariant<P>>(q);
+    }
+#elif SIMPLE_KERNEL
+    submitPrefixSumSimple<P>(q);
+#elif NUM_PIPELINES > 1
+    PipelineArray<P>::launch(q);
+#elif WIDE_LANES > 1
+    WideStream<P>::launch(q);
+#elif AGGREGATE
+    Aggregates<P>::launch(q);
+#elif MULTI_DEVICE
+    MultiDevice<P>::launch(deviceQueues(q, exception_handler));
+#elif GROUP_SCAN || HOST_MODEL
+    // nothing runs between scans
 #else
-    q.submit([&](handler &h) {
-      h.single_task<class PrefixSumB>(
-          [=]() { prefixSumB<SumPipe, DataPipe, OutPipe>(); });
-    });
-
-    q.submit([&](handler &h) {
-      h.single_task<class PrefixSumA>(
-          [=]() { prefixSumA<InPipe, SumPipe, DataPipe>(); });
-    });
-#endif
-
-    // Launch a kernel that copies input data from USM
-    // memory (initialized by host) into a pipe
-    event eventSource = q.submit([&](handler &h) {
-      sycl::accessor ibufPtr(idataBuf_usm, h, sycl::read_only);
-      h.single_task<class Input2Pipe>([=]() {
-        [[intel::initiation_interval(1)]] // insist II=1 schedule
-        for (int64_t i = 0; i < STRM_LEN; i += STRM_WIDTH) {
-          Flit flit = ibufPtr[i / STRM_WIDTH];
-          InPipe::write(flit);
-        }
-      });
-    });
-
-    eventSource.wait();
-    eventSink.wait();
-    elapseTime =
-        eventSource
-            .template get_profiling_info<info::event_profiling::command_end>() -
-        eventSource.template get_profiling_info<
-            info::event_profiling::command_start>();
-
-  } catch (std::exception const &e) {
-    std::cerr << "Exception! " << e.what() << std::endl;
-    std::terminate();
-  }
-
-  // This will cause data to migrate from device to host
-  sycl::host_accessor idataPtr(idataBuf_usm, read_only);
-  sycl::host_accessor odataPtr(odataBuf_usm, read_only);
-
-#if 0
-  for (int i = 0; i < 16; i++) {
-    // look at a few outputs
-    std::cout << odataPtr[i / STRM_WIDTH].element[i % STRM_WIDTH] << std::endl;
-  }
+    submitPrefixSumAB<P>(q);
 #endif
-  
-  {
-    Element prefixSum = 0;
-    for (int64_t i = 0; i < STRM_LEN; i += STRM_WIDTH) {
-      for (int64_t j = 0; j < STRM_WIDTH; j++) {
-        prefixSum += idataPtr[i / STRM_WIDTH].element[j];
-        if (prefixSum != odataPtr[i / STRM_WIDTH].element[j]) {
-          std::cout << "Sum incorrect." << std::endl;
-          return 1;
-        }
-      }
+#if COMPACT
+    Compactor<P, TestKeep>::launch(q);
+#endif
+#if STREAM_GRAPH
+    TestGraph<P>::launch(q);
+#endif
+  });
+
+#if BENCH
+  // mini_fpga [report.csv|report.json [datapath]]
+  std::string path = (argc > 1) ? argv[1] : "build/bench.csv";
+  std::string only = (argc > 2) ? argv[2] : "";
+  BenchReport report;
+  Paths::forEach([&](auto p) {
+    using P = decltype(p);
+    if (only.empty() || only == Paths::typeNameOf<P>()) {
+      runBench<P>(q, report);
     }
+  });
+  if (!report.write(path)) {
+    return 1;
   }
+  return report.allCorrect() ? 0 : 1;
+#endif
 
-  std::cout << "Sum is correct." << std::endl;
-  std::cout << elapseTime / 1E9 * 1E3 << " ms" << std::endl;
-  std::cout << "Streaming BW: "
-            << sizeof(Element) * (STRM_LEN / 1E9) / (elapseTime / 1E9)
-            << " GB/sec" << std::endl;
+  // pick the datapath at runtime
+  std::string which = (argc > 1) ? argv[1] : Paths::first();
+  int result = 1;
+  if (!Paths::dispatch(which, [&](auto p) {
+        using P = decltype(p);
+        std::cout << "Datapath: " << which << std::endl;
+        result = runTest<P>(q);
+      })) {
+    std::cerr << "ERROR: no " << which << " datapath in this build\n";
+  }
 
-  return 0;
+  return result;
 }
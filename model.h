@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "verify.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Host model of the A/B graph
+//
+// Under the FPGA emulator every flit goes through blocking emulated
+// pipes, one at a time, so a production-size stream takes minutes.
+// HostModel<P> is the source -> prefixSumA() -> prefixSumB() -> sink
+// graph of datapath P on the host, run a batch of MODEL_BATCH flits
+// at a time, stage by stage, instead of flit by flit:
+//
+//   source:      sourceFlit(), the same framing and restart heads
+//   prefixSumA:  flitReduce() of every flit of the batch
+//   prefixSumB:  the serial CarryLanes chain, one add() per flit, with
+//                the same eos reset, then flitScan() of every flit
+//   sink:        sinkStore()
+//
+// Everything but the carry chain runs across the host threads.  Each
+// stage is the kernels' own code, so the output is the device's bit
+// for bit, like mirrorScan(), and the carries persist from one run()
+// to the next as they do in the never-ending prefixSumB().  The model
+// is of the plain A/B datapath, not its windowed, tagged or resumable
+// variants.  -DHOST_MODEL=1 runs the test through it instead of the
+// device.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_MODEL
+#define HOST_MODEL 0
+#endif
+
+#ifndef MODEL_BATCH
+#define MODEL_BATCH (1 << 16)
+#endif
+
+template <typename P> class HostModel {
+public:
+  using F = typename P::Flit;
+  using PF = PipeData<typename P::Pipes::InPipe>;
+  static constexpr int W = P::width;
+
+  static_assert(P::window == 0 && P::streams == 0 &&
+                    !P::Checkpoint::enabled,
+                "the model is of the plain prefixSumB()");
+
+  // a source launch of the nflits flits of in, and the sink launch
+  // that stores them to out, with submitSource()'s restart, lastValid
+  // and eos
+  void run(const F *in, F *out, int64_t nflits, bool restart = false,
+           int lastValid = W, bool eos = false) {
+    std::vector<PF> flits(std::min<int64_t>(nflits, MODEL_BATCH));
+    std::vector<Carry> partial(flits.size());
+    std::vector<A> before(flits.size());
+    for (int64_t off = 0; off < nflits; off += MODEL_BATCH) {
+      int64_t n = std::min<int64_t>(MODEL_BATCH, nflits - off);
+      parallelFor(n, [&](int, int64_t begin, int64_t end) {
+        for (int64_t k = begin; k < end; k++) {
+          flits[k] = sourceFlit<P>(in[off + k], off + k, nflits, restart,
+                                   lastValid, eos);
+          partial[k] = flitReduce<Op, Scan>(flits[k]);
+        }
+      });
+      for (int64_t k = 0; k < n; k++) {
+        before[k] = carry_.sum();
+        carry_.add(partial[k]);
+        if constexpr (P::framed) {
+          if (flits[k].eos) {
+            carry_.reset();
+          }
+        }
+      }
+      parallelFor(n, [&](int, int64_t begin, int64_t end) {
+        for (int64_t k = begin; k < end; k++) {
+          sinkStore<P>(out[off + k], flitScan<Op, Scan>(before[k], flits[k]));
+        }
+      });
+    }
+  }
+
+private:
+  using Op = typename P::Op;
+  using Scan = typename P::Scan;
+  using A = typename P::Acc;
+  using Carry = StreamCarry<A, P::segmented>;
+
+  CarryLanes<typename AccumOf<Op>::Op, defaultCarryLanes<Op, PF>(),
+             P::segmented>
+      carry_;
+};
+
+// the model of P, made at first use; like the kernels it lives as
+// long as the program does
+template <typename P> HostModel<P> &hostModel() {
+  static HostModel<P> model;
+  return model;
+}
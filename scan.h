@@ -0,0 +1,1313 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "stream.h"
+#include "telemetry.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Scan operators
+//
+// The kernels below compute an inclusive scan under any associative
+// operator, not just +.  An operator provides
+//
+//   value_type:  what one flit element carries
+//   identity():  the value with apply(identity(), x) == x
+//   apply(a, b): a combined with b, where a comes earlier in the stream
+//   commutative: whether apply(a, b) == apply(b, a)
+//
+// apply() is always called with the earlier operand first, so
+// non-commutative operators such as AffineOp are scanned in order.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename T> struct SumOp {
+  using value_type = T;
+  static constexpr bool commutative = true;
+  static T identity() { return 0; }
+  static T apply(T a, T b) { return a + b; }
+};
+
+// a floating-point sum, whose result depends on the order of the adds
+template <typename TOp> struct IsFloatSum : std::false_type {};
+template <typename T>
+struct IsFloatSum<SumOp<T>> : std::is_floating_point<T> {};
+
+template <typename T> struct MaxOp {
+  using value_type = T;
+  static constexpr bool commutative = true;
+  static T identity() { return std::numeric_limits<T>::lowest(); }
+  static T apply(T a, T b) { return (b > a) ? b : a; }
+};
+
+template <typename T> struct MinOp {
+  using value_type = T;
+  static constexpr bool commutative = true;
+  static T identity() { return std::numeric_limits<T>::max(); }
+  static T apply(T a, T b) { return (b < a) ? b : a; }
+};
+
+template <typename T> struct XorOp {
+  static_assert(std::is_integral<T>::value, "XorOp needs an integer type");
+  using value_type = T;
+  static constexpr bool commutative = true;
+  static T identity() { return 0; }
+  static T apply(T a, T b) { return a ^ b; }
+};
+
+// y = a*y + b.  Each element is the step (a, b); the scan composes
+// steps, so element i of the output is the step from the start of the
+// stream to i, and its b is y[i] starting from y = 0.
+template <typename T> struct Affine {
+  T a;
+  T b;
+};
+
+template <typename T>
+bool operator==(const Affine<T> &x, const Affine<T> &y) {
+  return (x.a == y.a) && (x.b == y.b);
+}
+template <typename T>
+bool operator!=(const Affine<T> &x, const Affine<T> &y) {
+  return !(x == y);
+}
+
+template <typename T> struct AffineOp {
+  using value_type = Affine<T>;
+  static constexpr bool commutative = false;
+  static Affine<T> identity() { return {1, 0}; }
+  static Affine<T> apply(Affine<T> x, Affine<T> y) {
+    // y after x: a2*(a1*v + b1) + b2
+    return {(T)(y.a * x.a), (T)(y.a * x.b + y.b)};
+  }
+};
+
+// Segmented scan of TOp over Seg<T> elements: a head discards
+// everything before it.  Associative but not commutative; the head
+// bit of a result says whether a segment starts anywhere inside it.
+template <typename TOp> struct SegmentedOp {
+  using T = typename TOp::value_type;
+  using value_type = Seg<T>;
+  static constexpr bool commutative = false;
+  static Seg<T> identity() { return {TOp::identity(), false}; }
+  static Seg<T> apply(Seg<T> x, Seg<T> y) {
+    return {y.head ? y.value : TOp::apply(x.value, y.value), x.head || y.head};
+  }
+};
+
+// An operator may accumulate in a wider type than the stream carries;
+// ExactSumOp (exact.h) sums doubles in fixed point.  Such an operator
+// names AccOp, the operator the kernels actually scan with, and
+// lift()/lower() to convert its value_type to AccOp's and back.
+// AccumOf<TOp> reads these, and is TOp itself for every other
+// operator.  The kernels lift elements as they come off a flit and
+// lower them as they go onto one, so partial sums and carries are
+// always in the accumulator type.
+template <typename TOp, typename = void> struct AccumOf {
+  using Op = TOp;
+  using T = typename TOp::value_type;
+  static T lift(T x) { return x; }
+  static T lower(T x) { return x; }
+};
+
+template <typename TOp>
+struct AccumOf<TOp, std::void_t<typename TOp::AccOp>> {
+  using Op = typename TOp::AccOp;
+  static typename Op::value_type lift(typename TOp::value_type x) {
+    return TOp::lift(x);
+  }
+  static typename TOp::value_type lower(typename Op::value_type x) {
+    return TOp::lower(x);
+  }
+};
+
+template <typename TOp> using AccOf = typename AccumOf<TOp>::Op::value_type;
+
+#ifndef EWMA_ALPHA
+#define EWMA_ALPHA 0.125
+#endif
+
+// Exponentially weighted moving average, y[i] = (1 - alpha) * y[i-1] +
+// alpha * x[i] from y = 0, alpha = EWMA_ALPHA.  That is an affine
+// recurrence, so each element is lifted to the step (1 - alpha,
+// alpha * x) and the kernels scan AffineOp<double>.  Every step has
+// the same a, a constant, so the a of a flit's partial sum is the
+// power (1 - alpha)^W folded at compile time, and the loop-carried
+// update of the carry is a multiply by that constant and an add.
+// Integer elements are averaged in double and rounded to nearest.
+//
+// Every element decays the average, so no element leaves it alone:
+// identity() is only the starting value 0, whose step (1 - alpha, 0)
+// is not AffineOp's identity.  HasIdentity keeps EwmaOp out of the
+// datapaths that pad or filter with identity().
+template <typename T> struct EwmaOp {
+  static_assert(std::is_arithmetic<T>::value, "EwmaOp averages numbers");
+  using value_type = T;
+  using Acc = Affine<double>;
+  using AccOp = AffineOp<double>;
+  static constexpr bool commutative = false;
+  static T identity() { return T{}; }
+  static Acc lift(T x) { return {1.0 - EWMA_ALPHA, EWMA_ALPHA * (double)x}; }
+  static T lower(const Acc &y) {
+    if constexpr (std::is_floating_point<T>::value) {
+      return (T)y.b;
+    } else {
+      return (T)((y.b < 0) ? y.b - 0.5 : y.b + 0.5);
+    }
+  }
+};
+
+// whether TOp::identity() lifts to its accumulator's identity, so an
+// element padded or filtered to it drops out of a scan
+template <typename TOp> struct HasIdentity : std::true_type {};
+template <typename T> struct HasIdentity<EwmaOp<T>> : std::false_type {};
+
+//////////////////////////////////////////////////////////////////////////////
+// Intra-flit scan networks
+//
+// A scan network maps the W elements of one flit to their running
+// sums, starting from a carry-in.  Done as a serial chain, this is W
+// dependent adds; for double Element that is 8 cascaded FADDs.  The
+// tree networks below do the same in lg(W) levels, trading adders for
+// depth:
+//
+//   KoggeStoneScan: lg(W) levels, W*lg(W)-W+1 adders, fanout 2
+//   SklanskyScan:   lg(W) levels, W/2*lg(W) adders, high fanout
+//   BrentKungScan:  2*lg(W)-1 levels, 2*W-lg(W)-2 adders, fanout 2
+//
+// The networks are used as a template policy on prefixSumA() and
+// prefixSumB().  Each provides scan() and reduce(), and reduceLevels(W),
+// the number of dependent applies in reduce().  Every level ends
+// in stageReg(), so the compiler gets a register per level instead of
+// one deep combinational cloud.  None of this logic is on a
+// loop-carried path; it only adds latency.
+//////////////////////////////////////////////////////////////////////////////
+
+// balanced-tree reduction, lg(N) levels
+template <typename TOp, int N>
+typename TOp::value_type treeReduce(const typename TOp::value_type in[N]) {
+  typename TOp::value_type x[N];
+#pragma unroll
+  for (int i = 0; i < N; i++) {
+    x[i] = in[i];
+  }
+#pragma unroll
+  for (int d = 1; d < N; d *= 2) {
+#pragma unroll
+    for (int i = 0; i + d < N; i += 2 * d) {
+      x[i] = stageReg(TOp::apply(x[i], x[i + d]));
+    }
+  }
+  return x[0];
+}
+
+// out[i] = carry + in[0] + ... + in[i]; carry added last by the tree
+// networks so it enters 1 add before the output
+template <typename TOp, int W>
+void addCarry(typename TOp::value_type carry,
+              const typename TOp::value_type x[W],
+              typename TOp::value_type out[W]) {
+#pragma unroll
+  for (int i = 0; i < W; i++) {
+    out[i] = TOp::apply(carry, x[i]);
+  }
+}
+
+// The original serial chain.  Smallest, but its depth is W adds.
+struct SerialScan {
+  template <typename TOp, int W>
+  static void scan(typename TOp::value_type carry,
+                   const typename TOp::value_type in[W],
+                   typename TOp::value_type out[W]) {
+    typename TOp::value_type prefixSum = carry;
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      prefixSum = TOp::apply(prefixSum, in[i]);
+      out[i] = prefixSum;
+    }
+  }
+
+  template <typename TOp, int W>
+  static typename TOp::value_type
+  reduce(const typename TOp::value_type in[W]) {
+    typename TOp::value_type partialSum = TOp::identity();
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      partialSum = TOp::apply(partialSum, in[i]);
+    }
+    return partialSum;
+  }
+
+  static constexpr int reduceLevels(int W) { return W; }
+};
+
+struct KoggeStoneScan {
+  template <typename TOp, int W>
+  static void scan(typename TOp::value_type carry,
+                   const typename TOp::value_type in[W],
+                   typename TOp::value_type out[W]) {
+    typename TOp::value_type x[W];
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      x[i] = in[i];
+    }
+    // level d: every element picks up the one d positions behind it
+#pragma unroll
+    for (int d = 1; d < W; d *= 2) {
+      typename TOp::value_type y[W];
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        y[i] = stageReg((i >= d) ? TOp::apply(x[i - d], x[i]) : x[i]);
+      }
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        x[i] = y[i];
+      }
+    }
+    addCarry<TOp, W>(carry, x, out);
+  }
+
+  template <typename TOp, int W>
+  static typename TOp::value_type
+  reduce(const typename TOp::value_type in[W]) {
+    return treeReduce<TOp, W>(in);
+  }
+
+  static constexpr int reduceLevels(int W) { return log2Ceil(W); }
+};
+
+struct SklanskyScan {
+  template <typename TOp, int W>
+  static void scan(typename TOp::value_type carry,
+                   const typename TOp::value_type in[W],
+                   typename TOp::value_type out[W]) {
+    typename TOp::value_type x[W];
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      x[i] = in[i];
+    }
+    // level d: the upper half of each 2d block picks up the last
+    // element of the lower half
+#pragma unroll
+    for (int d = 1; d < W; d *= 2) {
+      typename TOp::value_type y[W];
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        int j = (i & ~(2 * d - 1)) + d - 1;
+        y[i] = stageReg((i & d) ? TOp::apply(x[j], x[i]) : x[i]);
+      }
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        x[i] = y[i];
+      }
+    }
+    addCarry<TOp, W>(carry, x, out);
+  }
+
+  template <typename TOp, int W>
+  static typename TOp::value_type
+  reduce(const typename TOp::value_type in[W]) {
+    return treeReduce<TOp, W>(in);
+  }
+
+  static constexpr int reduceLevels(int W) { return log2Ceil(W); }
+};
+
+struct BrentKungScan {
+  template <typename TOp, int W>
+  static void scan(typename TOp::value_type carry,
+                   const typename TOp::value_type in[W],
+                   typename TOp::value_type out[W]) {
+    static_assert((W & (W - 1)) == 0, "BrentKungScan needs a power-of-2 W");
+
+    typename TOp::value_type x[W];
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      x[i] = in[i];
+    }
+    // up-sweep: reduction tree, sums land on the odd positions
+#pragma unroll
+    for (int d = 1; d < W; d *= 2) {
+#pragma unroll
+      for (int i = 2 * d - 1; i < W; i += 2 * d) {
+        x[i] = TOp::apply(x[i - d], x[i]);
+      }
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        x[i] = stageReg(x[i]);
+      }
+    }
+    // down-sweep: fill in the remaining positions
+#pragma unroll
+    for (int d = W / 4; d >= 1; d /= 2) {
+#pragma unroll
+      for (int i = 3 * d - 1; i < W; i += 2 * d) {
+        x[i] = TOp::apply(x[i - d], x[i]);
+      }
+#pragma unroll
+      for (int i = 0; i < W; i++) {
+        x[i] = stageReg(x[i]);
+      }
+    }
+    addCarry<TOp, W>(carry, x, out);
+  }
+
+  template <typename TOp, int W>
+  static typename TOp::value_type
+  reduce(const typename TOp::value_type in[W]) {
+    return treeReduce<TOp, W>(in);
+  }
+
+  static constexpr int reduceLevels(int W) { return log2Ceil(W); }
+};
+
+// choose with -DSCAN_NETWORK=KoggeStoneScan etc.
+#ifndef SCAN_NETWORK
+#define SCAN_NETWORK SerialScan
+#endif
+
+#ifndef KAHAN_CARRY
+#define KAHAN_CARRY 0
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// Pipe depths
+//
+// The pipes change how much skew the stages can absorb, never whether
+// the A/B split makes progress: prefixSumA() puts exactly one token on
+// DataPipe and one on SumPipe per flit, in the same order, and
+// prefixSumB() takes one of each per flit, so with any depth >= 1
+// every token written is eventually read.  Too shallow a pipe costs
+// throughput instead:
+//
+//   DataPipe  A writes a flit as soon as it reads it, but its partial
+//             sum only reduceLevels() applies later, so in steady state
+//             DataPipe holds that many flits waiting for their sums.
+//             Shallower, and A stalls on every flit: II > 1.
+//   SumPipe   B reads each sum as it arrives; it only needs slack.
+//   InPipe,   the source and sink stall on memory, DDR refresh and
+//   OutPipe   page misses, for tens of cycles at a time; a pipe of
+//             MEM_JITTER flits lets the scan run on through such a stall.
+//
+// DerivedDepths<TOp, TScan, W> sizes the pipes that way, using
+// FP_ADD_LATENCY cycles per floating-point apply and 1 for the rest;
+// -DDERIVED_DEPTHS=1 makes it the default of every Datapath.  With
+// TELEMETRY, the longest write-stall run of each stage shows whether
+// a pipe was still too shallow for the jitter the run actually met.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef DERIVED_DEPTHS
+#define DERIVED_DEPTHS 0
+#endif
+
+#ifndef FP_ADD_LATENCY
+#define FP_ADD_LATENCY 4
+#endif
+
+#ifndef MEM_JITTER
+#define MEM_JITTER 64
+#endif
+
+// cycles of one TOp::apply(), and the slack of a pipe's own latency
+template <typename TOp> constexpr int applyLatency() {
+  return std::is_floating_point<typename TOp::value_type>::value
+             ? FP_ADD_LATENCY
+             : 1;
+}
+constexpr int kPipeSlack = 2;
+
+template <typename TOp, typename TScan, int W>
+using DerivedDepths = PipeDepths<
+    MEM_JITTER + kPipeSlack,
+    TScan::reduceLevels(W) * applyLatency<typename AccumOf<TOp>::Op>() +
+        kPipeSlack,
+    kPipeSlack, MEM_JITTER + kPipeSlack>;
+
+template <typename TOp, typename TScan, int W>
+using DefaultDepths = std::conditional_t<DERIVED_DEPTHS,
+                                         DerivedDepths<TOp, TScan, W>,
+                                         PipeDepths<>>;
+
+//////////////////////////////////////////////////////////////////////////////
+// The kernel example computes the prefix sums on the input
+// stream. That is, to produce the output strea, the kernel replaces
+// each element by the sum of all previous elements including itself.
+//
+// The kernel is writen as a function template so it is reusable with
+// different input and output pipe connections, and with different
+// scan operators (TOp, see above).  The flit type, and so the stream
+// width and whether it is segmented, follows from the pipes.
+//
+// Stream kernel never terminates; this is unusal for normal
+// compute-offload kernels.
+//////////////////////////////////////////////////////////////////////////////
+
+// In prefixSumSimple(), each iteration of the outermost while-loop
+// depends on the final sum of the previous iteration.  To achieve the
+// requested II=1, all elements in a flit must be summed together and
+// added to the running sum in 1 cyc, leading to a low clock
+// frequency.  The compiler cannot produce II=1 schedule for
+// double-type Element since combinational cascading of FADD is not
+// supported.
+
+template <typename TInPipe, typename TOutPipe,
+          typename TOp = SumOp<Element>>
+void prefixSumSimple() {
+  using T = typename TOp::value_type;
+  using F = PipeData<TInPipe>;
+  constexpr int W = F::width;
+  static_assert(std::is_same<F, FlitT<T, W>>::value,
+                "prefixSumSimple() takes plain flits of TOp::value_type");
+  using Acc = AccumOf<TOp>;
+
+  // this is state carried across time
+  typename Acc::Op::value_type prefixSum = Acc::Op::identity();
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  while (1) {
+    F iflit = TInPipe::read(); // get this iteration's input
+    F oflit;                   // output flit to be prepared
+
+    // need to unroll to initiate on a new flit each cycle
+#pragma unroll
+    for (int64_t i = 0; i < W; i++) {
+      prefixSum = Acc::Op::apply(prefixSum, Acc::lift(iflit.element[i]));
+      oflit.element[i] = Acc::lower(prefixSum);
+    }
+
+    TOutPipe::write(oflit); // push this iteration's output
+  }
+}
+
+// In this version, streaming prefix sum is computed in 2 kernels, A
+// and B.  prefixSumA() computes the sum across the Elements of the
+// same flit.  There is no dependency across iterations so high
+// frequency is achieviable for II=1 by pipelining. prefixSumA()
+// forwards both the flit and its partial sum to prefixSumB().
+// prefixSumB() computes the prefixSum of each element of a flit based
+// of the running sum from the last iteration. In this case, each
+// iteration need to update prefixSum=prefixSum+partialSum for the
+// next iteration.  Even if Element is double, II can still be 1, and
+// the clock period is lower bounded by performing 1 FADD (expect
+// about 100MHz).  The logic to map from iflit to oflit is substantial
+// and must perform at least lg(STRM_WIDTH) deep in dependent FADDs,
+// but this logic without depedence across iterations is trivially
+// pipelinable.  TScan selects the network used for both the per-flit
+// reduction in prefixSumA() and the per-flit scan in prefixSumB();
+// the tree networks get this down to lg(STRM_WIDTH) registered levels.
+// The split works the same for every TOp: only one apply() is ever
+// loop-carried.
+
+// For a Segmented stream, the flit elements are scanned as Seg<T>
+// under SegmentedOp<TOp>, so the networks restart at every head bit
+// within the flit.  prefixSumA() forwards the flit's Seg<T> reduction:
+// its value is the sum from the flit's last head (or its start), and
+// its head bit says whether the running sum must restart.
+
+// the elements of a flit in TOp's accumulator type, each tagged with
+// its head bit if the flit is segmented.  The invalid elements of a
+// framed flit are the accumulator's identity, whatever the source
+// padded them with, so they drop out of its reduction.
+template <typename TOp, typename F>
+void liftElements(const F &flit,
+                  StreamCarry<AccOf<TOp>, IsSegFlit<F>::value> s[F::width]) {
+  using Acc = AccumOf<TOp>;
+#pragma unroll
+  for (int i = 0; i < F::width; i++) {
+    AccOf<TOp> x = Acc::lift(flit.element[i]);
+    if constexpr (IsFramed<F>::value) {
+      x = ((flit.valid >> i) & 1) ? x : Acc::Op::identity();
+    }
+    if constexpr (IsSegFlit<F>::value) {
+      s[i] = {x, ((flit.heads >> i) & 1) != 0};
+    } else {
+      s[i] = x;
+    }
+  }
+}
+
+// partial sum of one flit, as forwarded by prefixSumA()
+template <typename TOp, typename TScan, typename F>
+StreamCarry<AccOf<TOp>, IsSegFlit<F>::value> flitReduce(const F &iflit) {
+  using AOp = typename AccumOf<TOp>::Op;
+  constexpr int W = F::width;
+  StreamCarry<AccOf<TOp>, IsSegFlit<F>::value> s[W];
+  liftElements<TOp>(iflit, s);
+  if constexpr (IsSegFlit<F>::value) {
+    return TScan::template reduce<SegmentedOp<AOp>, W>(s);
+  } else {
+    return TScan::template reduce<AOp, W>(s);
+  }
+}
+
+// The link from prefixSumA() to prefixSumB(): a DataPipe of flits and
+// a SumPipe of partial sums, or, given the same pipe for both, one
+// pipe of ABTokens (see ABPipe in stream.h).  tryWrite() and tryRead()
+// are the non-blocking versions for the counted kernels; they move
+// each half at most once, keeping track in the sent/have flags, and
+// return whether both are done.
+template <typename TSumPipe, typename TDataPipe> struct ABLink {
+  using Flit = PipeData<TDataPipe>;
+  using Carry = PipeData<TSumPipe>;
+
+  static void write(const Flit &flit, const Carry &partialSum) {
+    TSumPipe::write(partialSum); // forward sum of this flit
+    TDataPipe::write(flit);      // forward flit
+  }
+
+  static void read(Flit &flit, Carry &partialSum) {
+    flit = TDataPipe::read();
+    partialSum = TSumPipe::read();
+  }
+
+  static bool tryWrite(const Flit &flit, const Carry &partialSum,
+                       bool &dataSent, bool &sumSent) {
+    if (!sumSent) {
+      TSumPipe::write(partialSum, sumSent);
+    }
+    if (!dataSent) {
+      TDataPipe::write(flit, dataSent);
+    }
+    return dataSent && sumSent;
+  }
+
+  static bool tryRead(Flit &flit, Carry &partialSum, bool &haveData,
+                      bool &haveSum) {
+    if (!haveData) {
+      flit = TDataPipe::read(haveData);
+    }
+    if (!haveSum) {
+      partialSum = TSumPipe::read(haveSum);
+    }
+    return haveData && haveSum;
+  }
+};
+
+template <typename TPipe> struct ABLink<TPipe, TPipe> {
+  using Token = PipeData<TPipe>;
+  using Flit = decltype(Token::flit);
+  using Carry = decltype(Token::partialSum);
+
+  static void write(const Flit &flit, const Carry &partialSum) {
+    TPipe::write(Token{flit, partialSum}); // forward flit and its sum
+  }
+
+  static void read(Flit &flit, Carry &partialSum) {
+    Token t = TPipe::read();
+    flit = t.flit;
+    partialSum = t.partialSum;
+  }
+
+  static bool tryWrite(const Flit &flit, const Carry &partialSum,
+                       bool &dataSent, bool &sumSent) {
+    bool ok = false;
+    TPipe::write(Token{flit, partialSum}, ok);
+    dataSent = sumSent = ok;
+    return ok;
+  }
+
+  static bool tryRead(Flit &flit, Carry &partialSum, bool &haveData,
+                      bool &haveSum) {
+    bool ok = false;
+    Token t = TPipe::read(ok);
+    if (ok) {
+      flit = t.flit;
+      partialSum = t.partialSum;
+    }
+    haveData = haveSum = ok;
+    return ok;
+  }
+};
+
+// the flit type prefixSumB() reads
+template <typename TSumPipe, typename TDataPipe>
+using LinkFlit = typename ABLink<TSumPipe, TDataPipe>::Flit;
+
+template <typename TInPipe, typename TSumPipe, typename TDataPipe,
+          typename TOp = SumOp<Element>, typename TScan = SerialScan>
+void prefixSumA() {
+  using T = typename TOp::value_type;
+  using F = PipeData<TInPipe>;
+  constexpr bool Segmented = IsSegFlit<F>::value;
+  constexpr bool Framed = IsFramed<F>::value;
+  static_assert(
+      std::is_same<F, PipeFlit<T, Segmented, F::width, Framed>>::value,
+      "flit type does not match TOp::value_type");
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  while (1) {
+    F iflit = TInPipe::read(); // get this iteration's flit
+    StreamCarry<AccOf<TOp>, Segmented> partialSum =
+        flitReduce<TOp, TScan>(iflit);
+
+    ABLink<TSumPipe, TDataPipe>::write(iflit, partialSum);
+  }
+}
+
+// With KLanes > 1, prefixSumB() splits sumSoFar over KLanes rotating
+// carries.  Flit n adds its partial sum into the carry last touched by
+// flit n-KLanes, so the loop-carried add has KLanes cycles to finish.
+// The exact running sum for flit n is the sum of all KLanes carries;
+// this correction reads the carries but never feeds back into them,
+// so it is a pipelinable feed-forward tree like the scan network.
+// Regrouping the carries this way is only valid for commutative TOp;
+// non-commutative ones look ahead instead (see CarryLanes).
+
+// A Segmented prefixSumB() restarts sumSoFar when the flit's partial
+// sum carries a head.  That only adds a mux after the loop-carried
+// apply(), so II stays 1, but it needs the single carry (KLanes == 1).
+
+// the output flit of iflit, scanned on from sumSoFar
+template <typename TOp, typename TScan, typename F>
+F flitScan(AccOf<TOp> sumSoFar, const F &iflit) {
+  using Acc = AccumOf<TOp>;
+  constexpr int W = F::width;
+  StreamCarry<AccOf<TOp>, IsSegFlit<F>::value> s[W], o[W];
+  liftElements<TOp>(iflit, s);
+  F oflit = iflit; // keep heads and framing visible downstream
+  if constexpr (IsSegFlit<F>::value) {
+    TScan::template scan<SegmentedOp<typename Acc::Op>, W>({sumSoFar, false},
+                                                           s, o);
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      oflit.element[i] = Acc::lower(o[i].value);
+    }
+  } else {
+    TScan::template scan<typename Acc::Op, W>(sumSoFar, s, o);
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      oflit.element[i] = Acc::lower(o[i]);
+    }
+  }
+  return oflit;
+}
+
+// Rotating carries of prefixSumB(); lanes[KLanes-1] is due for update
+// next.  sum() is the running sum before the next flit.
+//
+// A non-commutative TOp cannot split the sum over lanes, so with
+// KLanes > 1 it uses look-ahead instead: lanes[j] is the running sum
+// after flit n-1-j, and flit n's is lanes[KLanes-1], the one KLanes
+// flits back, with the last KLanes partial sums applied.  Those are
+// composed from a shift register of partial sums, feed-forward, so
+// again the only loop-carried apply() is at distance KLanes, and
+// sum() is just lanes[0].  For EwmaOp, the composed steps' a is a
+// constant, (1 - alpha)^(W * KLanes).
+//
+// With Compensated (KAHAN_CARRY builds, floating-point SumOp only),
+// each lane keeps a Kahan compensation term, so a long double stream
+// does not drift by the rounding of every carry add.  That puts 4
+// dependent FADDs on the loop-carried path instead of 1; raise
+// CARRY_LANES to match.  Build with -fp-model=precise so the compiler
+// keeps the compensation.
+template <typename TOp, int KLanes, bool Segmented,
+          bool Compensated = (KAHAN_CARRY && IsFloatSum<TOp>::value)>
+struct CarryLanes {
+  using T = typename TOp::value_type;
+  static_assert(KLanes >= 1, "need at least 1 carry lane");
+  static_assert(KLanes == 1 || !Segmented,
+                "multi-lane carries cannot restart on segment heads");
+  static_assert(!Compensated || IsFloatSum<TOp>::value,
+                "compensated carries need a floating-point SumOp");
+
+  static constexpr bool kLookahead = KLanes > 1 && !TOp::commutative;
+
+  T lanes[KLanes];
+  T comp[KLanes];   // Kahan compensation, if Compensated
+  T recent[KLanes]; // look-ahead: the last KLanes-1 partial sums, oldest
+                    // first
+
+  explicit CarryLanes(T seed = TOp::identity()) {
+    reset();
+#pragma unroll
+    for (int j = 0; j < KLanes; j++) {
+      if (kLookahead || j == KLanes - 1) {
+        lanes[j] = seed;
+      }
+    }
+  }
+
+  // start over from the identity, at the end of a framed stream
+  void reset() {
+#pragma unroll
+    for (int j = 0; j < KLanes; j++) {
+      lanes[j] = TOp::identity();
+      comp[j] = T{};
+      recent[j] = TOp::identity();
+    }
+  }
+
+  // correction stage
+  T sum() const {
+    if constexpr (KLanes == 1 || kLookahead) {
+      return lanes[0];
+    } else {
+      return treeReduce<TOp, KLanes>(lanes);
+    }
+  }
+
+  // rotate the lanes; the only loop-carried add, at distance KLanes
+  void add(const StreamCarry<T, Segmented> &partialSum) {
+    T x, updated, updatedComp = T{};
+    bool restart = false;
+    if constexpr (Segmented) {
+      x = partialSum.value;
+      restart = partialSum.head;
+    } else {
+      x = partialSum;
+    }
+
+    T last = lanes[KLanes - 1];
+    if constexpr (kLookahead) {
+      // the partial sums of flits n-KLanes+1 .. n, in order
+      T steps[KLanes];
+#pragma unroll
+      for (int j = 0; j < KLanes - 1; j++) {
+        steps[j] = recent[j];
+        recent[j] = recent[j + 1];
+      }
+      steps[KLanes - 1] = x;
+      recent[KLanes - 2] = x;
+      updated = TOp::apply(last, treeReduce<TOp, KLanes>(steps));
+    } else if constexpr (Compensated) {
+      T y = x - comp[KLanes - 1];
+      T t = last + y;
+      updated = restart ? x : t;
+      updatedComp = restart ? T{} : (t - last) - y;
+    } else {
+      updated = restart ? x : TOp::apply(last, x);
+    }
+
+#pragma unroll
+    for (int j = KLanes - 1; j > 0; j--) {
+      lanes[j] = lanes[j - 1];
+      comp[j] = comp[j - 1];
+    }
+    lanes[0] = updated;
+    comp[0] = updatedComp;
+  }
+};
+
+template <typename TOp, typename F>
+constexpr int defaultCarryLanes() {
+  return !IsSegFlit<F>::value ? CARRY_LANES : 1;
+}
+
+// The checkpoint pipes of prefixSumB(), for resuming a scan across
+// launches (see checkpoint.h): with enabled, each framed stream's
+// running sum starts from a seed read off SeedPipe at its first flit,
+// and its final one is written to CarryPipe after its eos flit.
+// Datapaths have none.
+struct NoCheckpoint {
+  static constexpr bool enabled = false;
+};
+
+template <typename TSumPipe, typename TDataPipe, typename TOutPipe,
+          typename TOp = SumOp<Element>, typename TScan = SerialScan,
+          int KLanes =
+              defaultCarryLanes<TOp, LinkFlit<TSumPipe, TDataPipe>>(),
+          typename TCkpt = NoCheckpoint>
+void prefixSumB() {
+  using T = typename TOp::value_type;
+  using F = LinkFlit<TSumPipe, TDataPipe>;
+  constexpr bool Segmented = IsSegFlit<F>::value;
+  constexpr bool Framed = IsFramed<F>::value;
+  static_assert(
+      std::is_same<F, PipeFlit<T, Segmented, F::width, Framed>>::value,
+      "flit type does not match TOp::value_type");
+  static_assert(!TCkpt::enabled || Framed,
+                "checkpoints are taken at the ends of framed streams");
+  using Carry = CarryLanes<typename AccumOf<TOp>::Op, KLanes, Segmented>;
+
+  // this is state carried across time; sumSoFar is the sum of all
+  // lanes
+  Carry carry;
+  bool fresh = true; // the next flit starts a stream
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  while (1) {
+    // get this iteration's inputs (flit and its precomputed partial
+    // sum)
+    F iflit;
+    StreamCarry<AccOf<TOp>, Segmented> partialSum;
+    ABLink<TSumPipe, TDataPipe>::read(iflit, partialSum);
+    if constexpr (TCkpt::enabled) {
+      if (fresh) {
+        carry = Carry(TCkpt::SeedPipe::read()); // resume from the seed
+      }
+      fresh = false;
+    }
+
+    // correction stage: running sum before this flit
+    AccOf<TOp> sumSoFar = carry.sum();
+
+    // only reads sumSoFar; the scan network is fully unrolled so a new
+    // flit can initiate each cycle
+    F oflit = flitScan<TOp, TScan>(sumSoFar, iflit);
+
+    carry.add(partialSum);
+    if constexpr (IsFramed<F>::value) {
+      if (iflit.eos) {
+        if constexpr (TCkpt::enabled) {
+          TCkpt::CarryPipe::write(carry.sum()); // the checkpoint
+        }
+        carry.reset(); // the next flit starts a new stream
+        fresh = true;
+      }
+    }
+
+    TOutPipe::write(oflit); // forward flit
+  }
+}
+
+// prefixSumB() over a sliding window: element i of the output is the
+// scan of the KFlits * W elements up to and including it, the window
+// of flit n reaching back into flit n-KFlits.  That is
+//
+//   (elements of flit n-KFlits after i) + (flits n-KFlits+1 .. n-1)
+//     + (elements of flit n up to i)
+//
+// in stream order: a reverse scan of the old flit, the partial sums
+// of the flits in between off a shift register, and the flit's own
+// scan.  Every term comes from a flit that is already here, so, unlike
+// the running sum, there is no loop-carried apply() at all and any
+// TOp, even MaxOp, runs at II=1 without carry lanes.  The old flits'
+// lifted elements wait in an on-chip ring; the flits in between cost
+// KFlits - 2 applies per flit, so keep the window to tens of flits,
+// or, for long integer windows, use the subtracting windowSum() of
+// aggregate.h.  On a framed stream the window starts over after eos.
+template <typename TSumPipe, typename TDataPipe, typename TOutPipe,
+          typename TOp, typename TScan, int KFlits>
+void prefixSumBWindow() {
+  using F = LinkFlit<TSumPipe, TDataPipe>;
+  using A = AccOf<TOp>;
+  using Acc = AccumOf<TOp>;
+  using AOp = typename Acc::Op;
+  constexpr int W = F::width;
+  static_assert(!IsSegFlit<F>::value,
+                "windows do not restart at segment heads");
+  static_assert(KFlits >= 1, "a window of at least a flit");
+
+  A past[KFlits][W]; // lifted elements of the last KFlits flits, a ring
+  // partial sums of the last KFlits-1 flits, oldest first; unused if
+  // KFlits == 1
+  A between[(KFlits > 1) ? KFlits - 1 : 1];
+#pragma unroll
+  for (int j = 0; j < KFlits - 1; j++) {
+    between[j] = AOp::identity();
+  }
+  int k = 0;   // the ring slot of flit n-KFlits
+  int age = 0; // flits since the start, up to KFlits
+
+  // a ring slot is read and rewritten once every KFlits flits
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  [[intel::ivdep(past, KFlits)]]
+  while (1) {
+    F iflit;
+    A partialSum;
+    ABLink<TSumPipe, TDataPipe>::read(iflit, partialSum);
+
+    A x[W], prefix[W], suffix[W];
+    liftElements<TOp>(iflit, x);
+    TScan::template scan<AOp, W>(AOp::identity(), x, prefix);
+
+    // flit n-KFlits after each index; identity before the start
+    A after = AOp::identity();
+#pragma unroll
+    for (int i = W - 1; i >= 0; i--) {
+      suffix[i] = after;
+      after = AOp::apply(age == KFlits ? past[k][i] : AOp::identity(), after);
+    }
+
+    A mid = AOp::identity();
+    if constexpr (KFlits > 1) {
+      mid = treeReduce<AOp, KFlits - 1>(between);
+    }
+
+    F oflit = iflit;
+#pragma unroll
+    for (int i = 0; i < W; i++) {
+      oflit.element[i] =
+          Acc::lower(AOp::apply(AOp::apply(suffix[i], mid), prefix[i]));
+      past[k][i] = x[i];
+    }
+
+    if constexpr (KFlits > 1) {
+#pragma unroll
+      for (int j = 0; j < KFlits - 2; j++) {
+        between[j] = between[j + 1];
+      }
+      between[KFlits - 2] = partialSum;
+    }
+    k = (k == KFlits - 1) ? 0 : k + 1;
+    age = (age == KFlits) ? age : age + 1;
+
+    if constexpr (IsFramed<F>::value) {
+      if (iflit.eos) {
+        // the next flit starts a new stream
+#pragma unroll
+        for (int j = 0; j < KFlits - 1; j++) {
+          between[j] = AOp::identity();
+        }
+        age = 0;
+      }
+    }
+
+    TOutPipe::write(oflit);
+  }
+}
+
+// prefixSumB() for many interleaved streams on one pipeline.  Each
+// flit comes with a StreamTag on TTagPipe, and the running sum of each
+// of NStreams streams is kept in an on-chip table, so a stream's flits
+// may arrive in any interleaving with the others', and the number of
+// streams in use is up to the host.
+//
+// The table is a RAM whose read-add-write takes several cycles, so
+// at II=1 the next flit's read would miss a write still on its way
+// for a flit of the same stream.  The last TAG_FORWARD updates are
+// also kept in registers and, when their stream matches, forwarded
+// in place of the table's stale value; ivdep tells the compiler the
+// table itself is only re-read TAG_FORWARD flits later.  Back-to-back
+// flits of one stream then pass their sum through the forwarding mux
+// and one apply(), the same loop-carried path prefixSumB() has with a
+// single carry, so this suits operators whose apply() fits a cycle.
+#ifndef TAG_FORWARD
+#define TAG_FORWARD 4
+#endif
+
+template <typename TSumPipe, typename TDataPipe, typename TTagPipe,
+          typename TOutPipe, typename TOp, typename TScan, int NStreams>
+void prefixSumBTagged() {
+  using F = LinkFlit<TSumPipe, TDataPipe>;
+  using A = AccOf<TOp>;
+  using AOp = typename AccumOf<TOp>::Op;
+  constexpr int D = TAG_FORWARD;
+  static_assert(!IsSegFlit<F>::value && !IsFramed<F>::value,
+                "tagged streams restart by their tags");
+  static_assert(NStreams >= 1 && D >= 1, "need streams and forwarding");
+
+  A table[NStreams]; // running sum of each stream
+  for (int s = 0; s < NStreams; s++) {
+    table[s] = AOp::identity();
+  }
+  uint32_t recentId[D]; // the last D updates, oldest first
+  A recentSum[D];
+#pragma unroll
+  for (int j = 0; j < D; j++) {
+    recentId[j] = NStreams; // no stream
+    recentSum[j] = AOp::identity();
+  }
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  [[intel::ivdep(table, TAG_FORWARD)]]
+  while (1) {
+    F iflit;
+    A partialSum;
+    ABLink<TSumPipe, TDataPipe>::read(iflit, partialSum);
+    StreamTag tag = TTagPipe::read();
+
+    // the stream's running sum, the newest forwarded one if any
+    A sumSoFar = table[tag.id];
+#pragma unroll
+    for (int j = 0; j < D; j++) {
+      if (recentId[j] == tag.id) {
+        sumSoFar = recentSum[j];
+      }
+    }
+    if (tag.restart) {
+      sumSoFar = AOp::identity();
+    }
+
+    F oflit = flitScan<TOp, TScan>(sumSoFar, iflit);
+
+    A updated = AOp::apply(sumSoFar, partialSum);
+    table[tag.id] = updated;
+#pragma unroll
+    for (int j = 0; j < D - 1; j++) {
+      recentId[j] = recentId[j + 1];
+      recentSum[j] = recentSum[j + 1];
+    }
+    recentId[D - 1] = tag.id;
+    recentSum[D - 1] = updated;
+
+    TOutPipe::write(oflit);
+  }
+}
+
+// Counted versions of prefixSumA() and prefixSumB() for TELEMETRY
+// builds (see telemetry.h).  Same datapath, but a flit that cannot be
+// forwarded is held and retried, and every iteration is counted as
+// active, a read stall or a write stall.
+
+template <typename TInPipe, typename TSumPipe, typename TDataPipe,
+          typename TOp = SumOp<Element>, typename TScan = SerialScan>
+void prefixSumACounted(StageStats *stats) {
+  using F = PipeData<TInPipe>;
+  constexpr bool Segmented = IsSegFlit<F>::value;
+
+  StageCounter c;
+  F iflit{};
+  StreamCarry<AccOf<TOp>, Segmented> partialSum{};
+  bool holding = false, sumSent = false, dataSent = false;
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  while (1) {
+    if (holding) {
+      holding = !ABLink<TSumPipe, TDataPipe>::tryWrite(iflit, partialSum,
+                                                       dataSent, sumSent);
+    }
+
+    if (holding) {
+      c.writeStall();
+    } else if (c.tryRead<TInPipe>(iflit)) {
+      partialSum = flitReduce<TOp, TScan>(iflit);
+      holding = true;
+      sumSent = dataSent = false;
+      c.active();
+    } else {
+      c.readStall();
+    }
+
+    c.flushIdle(stats);
+  }
+}
+
+template <typename TSumPipe, typename TDataPipe, typename TOutPipe,
+          typename TOp = SumOp<Element>, typename TScan = SerialScan,
+          int KLanes =
+              defaultCarryLanes<TOp, LinkFlit<TSumPipe, TDataPipe>>()>
+void prefixSumBCounted(StageStats *stats) {
+  using F = LinkFlit<TSumPipe, TDataPipe>;
+  constexpr bool Segmented = IsSegFlit<F>::value;
+
+  StageCounter c;
+  CarryLanes<typename AccumOf<TOp>::Op, KLanes, Segmented> carry;
+  F iflit{}, oflit{};
+  StreamCarry<AccOf<TOp>, Segmented> partialSum{};
+  bool haveData = false, haveSum = false, holding = false;
+
+  [[intel::initiation_interval(1)]] // insist II=1 schedule
+  while (1) {
+    if (holding) {
+      holding = !c.tryWrite<TOutPipe>(oflit);
+    }
+
+    if (holding) {
+      c.writeStall();
+    } else {
+      if (ABLink<TSumPipe, TDataPipe>::tryRead(iflit, partialSum, haveData,
+                                               haveSum)) {
+        oflit = flitScan<TOp, TScan>(carry.sum(), iflit);
+        carry.add(partialSum);
+        if constexpr (IsFramed<F>::value) {
+          if (iflit.eos) {
+            carry.reset();
+          }
+        }
+        haveData = haveSum = false;
+        holding = true;
+        c.active();
+      } else {
+        c.readStall();
+      }
+    }
+
+    c.flushIdle(stats);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Datapaths
+//
+// A Datapath bundles everything one scan pipeline is built from: the
+// operator, the intra-flit network, whether the stream is segmented,
+// the flit width, and whether its pipes are framed.  Flit is the
+// stream's flit in memory; the pipes may carry more (Pipes::Flit).
+// The Datapath type also serves as the tag of its pipes and kernel
+// names, so each Datapath used is its own hardware and several (e.g.
+// uint16, uint64 and double sums) can share one bitstream.
+// DatapathSet lists the datapaths of a build and lets the host pick
+// one at runtime by name.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename T> const char *typeName();
+template <> inline const char *typeName<uint16_t>() { return "uint16"; }
+template <> inline const char *typeName<uint32_t>() { return "uint32"; }
+template <> inline const char *typeName<uint64_t>() { return "uint64"; }
+template <> inline const char *typeName<float>() { return "float"; }
+template <> inline const char *typeName<double>() { return "double"; }
+
+// a datapath over Affine<T> etc. is named after T
+template <typename V> struct ScalarOf {
+  using type = V;
+};
+template <typename V> struct ScalarOf<Affine<V>> {
+  using type = V;
+};
+
+template <typename TOp, bool Segmented = false,
+          typename TScan = SCAN_NETWORK,
+          int W = defaultWidth<typename TOp::value_type>(),
+          bool Framed = FRAMED,
+          typename TDepths = DefaultDepths<TOp, TScan, W>>
+struct Datapath {
+  static_assert(!Framed || HasIdentity<TOp>::value,
+                "a framed stream pads its last flit with TOp::identity()");
+  using Op = TOp;
+  using Scan = TScan;
+  using Value = typename TOp::value_type;
+  using Acc = AccOf<TOp>; // what the partial sums and carries are in
+  using Depths = TDepths;
+  using Pipes =
+      StreamPipes<Datapath, Value, Segmented, W, Acc, Framed, TDepths>;
+  using Flit = StreamFlit<Value, Segmented, W>; // in memory
+  static constexpr bool segmented = Segmented;
+  static constexpr int width = W;
+  static constexpr bool framed = Framed;
+  static constexpr int window = 0;  // prefixSumBWindow() elements, or 0
+  static constexpr int streams = 0; // prefixSumBTagged() streams, or 0
+  using Checkpoint = NoCheckpoint;  // prefixSumB()'s checkpoint pipes
+};
+
+// datapath P with prefixSumB() over a sliding window of N elements, a
+// multiple of its width (see prefixSumBWindow()); its pipes are P's
+template <typename P, int N> struct Windowed : P {
+  static_assert(N >= P::width && N % P::width == 0,
+                "a window is a whole number of flits");
+  static constexpr int window = N;
+};
+
+template <typename Tag> class TagPipe_id;
+
+// datapath P over up to N interleaved streams, its flits tagged (see
+// prefixSumBTagged()); its pipes are P's, plus TagPipe from the source
+// to prefixSumB(), deep enough for the flits in between
+template <typename P, int N> struct Tagged : P {
+  static_assert(P::window == 0, "tagged and windowed are exclusive");
+  static constexpr int streams = N;
+  using TagPipe = sycl::ext::intel::pipe<TagPipe_id<P>, StreamTag,
+                                         P::Depths::in + P::Depths::data>;
+};
+
+// the pipes of datapath P for another tag, e.g. a replica of P
+template <typename Tag, typename P>
+using PipesOf = StreamPipes<Tag, typename P::Value, P::segmented, P::width,
+                            typename P::Acc, P::framed, typename P::Depths>;
+
+template <typename... TPaths> struct DatapathSet {
+  // call f(P{}) for every datapath P
+  template <typename Fn> static void forEach(Fn &&f) { (f(TPaths{}), ...); }
+
+  // call f(P{}) for the datapath whose element type is named name;
+  // returns false if there is none
+  template <typename Fn> static bool dispatch(const std::string &name, Fn &&f) {
+    bool found = false;
+    forEach([&](auto p) {
+      using P = decltype(p);
+      if (!found && name == typeNameOf<P>()) {
+        found = true;
+        f(p);
+      }
+    });
+    return found;
+  }
+
+  // the name of the first datapath, a default for dispatch()
+  static std::string first() {
+    std::string name;
+    forEach([&](auto p) {
+      if (name.empty()) {
+        name = typeNameOf<decltype(p)>();
+      }
+    });
+    return name;
+  }
+
+  template <typename P> static std::string typeNameOf() {
+    return typeName<typename ScalarOf<typename P::Value>::type>();
+  }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Launch helpers
+//
+// Kernel names are templated on the Datapath so each instance is its
+// own kernel.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename Tag> class PrefixSum_k;
+template <typename Tag> class PrefixSumA_k;
+template <typename Tag> class PrefixSumB_k;
+
+template <typename TPath> void submitPrefixSumSimple(sycl::queue &q) {
+  using P = typename TPath::Pipes;
+  q.submit([&](sycl::handler &h) {
+    h.single_task<PrefixSum_k<TPath>>([=]() {
+      prefixSumSimple<typename P::InPipe, typename P::OutPipe,
+                      typename TPath::Op>();
+    });
+  });
+}
+
+// the pipes prefixSumA() and prefixSumB() of P link through: ABPipe
+// as both with MERGED_AB_PIPE
+template <typename P>
+using ABSumPipe = std::conditional_t<MERGED_AB_PIPE, typename P::ABPipe,
+                                     typename P::SumPipe>;
+template <typename P>
+using ABDataPipe = std::conditional_t<MERGED_AB_PIPE, typename P::ABPipe,
+                                      typename P::DataPipe>;
+
+// launches B before A, back-to-front like main()
+template <typename TPath> void submitPrefixSumAB(sycl::queue &q) {
+  static_assert(!TELEMETRY || (TPath::window == 0 && TPath::streams == 0 &&
+                                !TPath::Checkpoint::enabled),
+                "windowed, tagged and resumable datapaths have no counted "
+                "prefixSumB()");
+  using P = typename TPath::Pipes;
+  using SumPipe = ABSumPipe<P>;
+  using DataPipe = ABDataPipe<P>;
+#if TELEMETRY
+  StageStats *stats = telemetryStats<TPath>(q);
+#endif
+  q.submit([&](sycl::handler &h) {
+    h.single_task<PrefixSumB_k<TPath>>([=]() {
+#if TELEMETRY
+      prefixSumBCounted<SumPipe, DataPipe, typename P::OutPipe,
+                        typename TPath::Op, typename TPath::Scan>(stats +
+                                                                  kStageB);
+#else
+      if constexpr (TPath::streams > 0) {
+        prefixSumBTagged<SumPipe, DataPipe, typename TPath::TagPipe,
+                         typename P::OutPipe, typename TPath::Op,
+                         typename TPath::Scan, TPath::streams>();
+      } else if constexpr (TPath::window > 0) {
+        prefixSumBWindow<SumPipe, DataPipe, typename P::OutPipe,
+                         typename TPath::Op, typename TPath::Scan,
+                         TPath::window / TPath::width>();
+      } else {
+        using Op = typename TPath::Op;
+        prefixSumB<SumPipe, DataPipe, typename P::OutPipe, Op,
+                   typename TPath::Scan,
+                   defaultCarryLanes<Op, LinkFlit<SumPipe, DataPipe>>(),
+                   typename TPath::Checkpoint>();
+      }
+#endif
+    });
+  });
+
+  q.submit([&](sycl::handler &h) {
+    h.single_task<PrefixSumA_k<TPath>>([=]() {
+#if TELEMETRY
+      prefixSumACounted<typename P::InPipe, SumPipe, DataPipe,
+                        typename TPath::Op, typename TPath::Scan>(stats +
+                                                                  kStageA);
+#else
+      prefixSumA<typename P::InPipe, SumPipe, DataPipe, typename TPath::Op,
+                 typename TPath::Scan>();
+#endif
+    });
+  });
+}
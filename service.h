@@ -0,0 +1,157 @@
+#pragma once
+
+#include <iostream>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Persistent scan service
+//
+// In the batch and chunked modes (host_io.h) the host launches a
+// source and a sink kernel per job, and each launch costs tens of
+// microseconds.  In service mode the source and sink kernels are
+// launched once, like the scan kernels, and never return until told
+// to.  The host rings them with job descriptors through a host pipe:
+//
+//   host -> CmdPipe -> ServiceSource -> JobPipe -> ServiceSink
+//                           |                          |
+//                        InPipe -> (scan kernels) -> OutPipe
+//                                                      |
+//   host <------------------ DonePipe <----------------+
+//
+// ServiceSource streams each job's flits into the datapath and passes
+// the job on to ServiceSink, which drains the same number of flits to
+// the job's output and reports the job id on DonePipe.  Jobs go back
+// to back with no kernel launches in between.
+//
+// A pipe has one writer and one reader, so a -DSERVICE=1 build feeds
+// its datapaths only through the service kernels.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef SERVICE
+#define SERVICE 0
+#endif
+
+// job opcodes
+enum JobOp : uint32_t {
+  kJobContinue = 0, // carry the running scan on from the previous job
+  kJobRestart = 1,  // start a new scan; needs a segmented datapath
+  kJobStop = 2,     // make the service kernels return
+};
+
+// A job descriptor.  in and out are USM pointers (device, host or
+// shared) the kernels can reach.
+template <typename F> struct Job {
+  const F *in;
+  F *out;
+  int64_t nflits;
+  uint32_t op;
+  uint32_t id;
+};
+
+#define SERVICE_CMD_DEPTH (8)
+
+template <typename Tag> class CmdPipe_id;
+template <typename Tag> class JobPipe_id;
+template <typename Tag> class DonePipe_id;
+
+template <typename P> struct ServicePipes {
+  using J = Job<typename P::Flit>;
+
+  // host -> source: job descriptors
+  using CmdPipe = sycl::ext::intel::experimental::pipe<CmdPipe_id<P>, J,
+                                                       SERVICE_CMD_DEPTH>;
+  // source -> sink: the job whose flits are on the way
+  using JobPipe =
+      sycl::ext::intel::pipe<JobPipe_id<P>, J, SERVICE_CMD_DEPTH>;
+  // sink -> host: ids of finished jobs
+  using DonePipe = sycl::ext::intel::experimental::pipe<DonePipe_id<P>,
+                                                        uint32_t,
+                                                        SERVICE_CMD_DEPTH>;
+};
+
+template <typename P> class ServiceSource;
+template <typename P> class ServiceSink;
+
+template <typename P> class ScanService {
+  static_assert(!P::framed, "the service moves whole flits");
+
+public:
+  using F = typename P::Flit;
+  using J = Job<F>;
+  using SP = ServicePipes<P>;
+
+  // launches the source and sink; the datapath's scan kernels must be
+  // launched separately as usual
+  explicit ScanService(sycl::queue &q) : q_(q) {
+    using OutPipe = typename P::Pipes::OutPipe;
+    using JobPipe = typename SP::JobPipe;
+    using DonePipe = typename SP::DonePipe;
+    sink_ = q.submit([&](sycl::handler &h) {
+      h.single_task<ServiceSink<P>>([=]() {
+        while (1) {
+          J job = JobPipe::read();
+          if (job.op == kJobStop) {
+            break;
+          }
+          [[intel::initiation_interval(1)]] // insist II=1 schedule
+          for (int64_t i = 0; i < job.nflits; i++) {
+            F flit = OutPipe::read();
+            job.out[i] = flit;
+          }
+          DonePipe::write(job.id);
+        }
+      });
+    });
+
+    using InPipe = typename P::Pipes::InPipe;
+    using CmdPipe = typename SP::CmdPipe;
+    source_ = q.submit([&](sycl::handler &h) {
+      h.single_task<ServiceSource<P>>([=]() {
+        while (1) {
+          J job = CmdPipe::read();
+          JobPipe::write(job);
+          if (job.op == kJobStop) {
+            break;
+          }
+          [[intel::initiation_interval(1)]] // insist II=1 schedule
+          for (int64_t i = 0; i < job.nflits; i++) {
+            F flit = job.in[i];
+            if constexpr (P::segmented) {
+              // a restart is a segment head on the job's first element
+              if (job.op == kJobRestart && i == 0) {
+                flit.heads |= 1;
+              }
+            }
+            InPipe::write(flit);
+          }
+        }
+      });
+    });
+  }
+
+  // ring the doorbell; blocks only if SERVICE_CMD_DEPTH jobs are queued
+  void submit(const J &job) {
+    if (job.op == kJobRestart && !P::segmented) {
+      std::cerr << "ERROR: restarting jobs need a segmented datapath\n";
+      std::terminate();
+    }
+    SP::CmdPipe::write(q_, job);
+  }
+
+  // blocks until the next job finishes and returns its id; jobs finish
+  // in submission order
+  uint32_t waitDone() { return SP::DonePipe::read(q_); }
+
+  // lets both service kernels return
+  void stop() {
+    SP::CmdPipe::write(q_, J{nullptr, nullptr, 0, kJobStop, 0});
+    source_.wait();
+    sink_.wait();
+  }
+
+private:
+  sycl::queue &q_;
+  sycl::event source_;
+  sycl::event sink_;
+};
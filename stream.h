@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include <sycl/sycl.hpp>
+
+#if FPGA_EMULATOR || FPGA_HARDWARE || FPGA_SIMULATOR
+#include <sycl/ext/intel/fpga_extensions.hpp>
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// Declare stream element and flit type
+//////////////////////////////////////////////////////////////////////////////
+
+// e.g. -DELEMENT=double or -DELEMENT=uint16_t
+#ifndef ELEMENT
+#define ELEMENT uint64_t
+#endif
+
+typedef ELEMENT Element;
+
+// handle multiple elements per cycle for concurrency.  By default a
+// flit is FLIT_BYTES (64) bytes, one DDR burst word, so its width
+// depends on what it carries.
+#ifndef FLIT_BYTES
+#define FLIT_BYTES 64
+#endif
+
+template <typename T> constexpr int defaultWidth() {
+  static_assert(FLIT_BYTES % sizeof(T) == 0,
+                "a flit must hold a whole number of elements");
+  return (int)(FLIT_BYTES / sizeof(T));
+}
+
+template <typename T, int W = defaultWidth<T>()> struct FlitT {
+  static constexpr int width = W;
+  T element[width];
+};
+
+#define STRM_WIDTH (FlitT<Element>::width)
+typedef FlitT<Element> Flit;
+
+// a bitmask with one bit per flit element
+template <int W>
+using MaskT = std::conditional_t<
+    (W <= 8), uint8_t,
+    std::conditional_t<(W <= 16), uint16_t,
+                       std::conditional_t<(W <= 32), uint32_t, uint64_t>>>;
+
+// A flit with segment-head sideband for segmented scans.  Bit i of
+// heads set means element[i] starts a new segment, so the scan
+// restarts there.  The first element of a stream is always a head.
+template <typename T, int W = defaultWidth<T>()> struct SegFlitT {
+  static constexpr int width = W;
+  T element[width];
+  MaskT<width> heads;
+};
+
+// an element tagged with whether a segment starts in it; this is what
+// a segmented scan carries between kernels
+template <typename T> struct Seg {
+  T value;
+  bool head;
+};
+
+// A flit of a framed stream, as the pipes carry it: flit F plus how
+// many of its elements are valid and whether it ends its stream.  A
+// framed stream can end anywhere, not just on a flit boundary; the
+// source fills the invalid elements of its last flit with the identity,
+// the scan kernels mask them to their accumulator's identity anyway,
+// prefixSumB() starts over after the eos flit, and the sink stores
+// only the valid elements.  In memory the stream is plain flits F.
+template <typename F> struct FramedFlit : F {
+  MaskT<F::width> valid; // bit i set if element[i] is valid, a prefix
+  bool eos;              // the last flit of its stream
+};
+
+// flit and carry types of a plain or segmented stream
+template <typename T, bool Segmented, int W = defaultWidth<T>()>
+using StreamFlit =
+    std::conditional_t<Segmented, SegFlitT<T, W>, FlitT<T, W>>;
+template <typename T, bool Segmented>
+using StreamCarry = std::conditional_t<Segmented, Seg<T>, T>;
+
+// what the pipes of a stream carry
+template <typename T, bool Segmented, int W = defaultWidth<T>(),
+          bool Framed = false>
+using PipeFlit = std::conditional_t<Framed,
+                                    FramedFlit<StreamFlit<T, Segmented, W>>,
+                                    StreamFlit<T, Segmented, W>>;
+
+template <typename F> struct IsSegFlit : std::false_type {};
+template <typename T, int W>
+struct IsSegFlit<SegFlitT<T, W>> : std::true_type {};
+template <typename F> struct IsSegFlit<FramedFlit<F>> : IsSegFlit<F> {};
+
+template <typename F> struct IsFramed : std::false_type {};
+template <typename F> struct IsFramed<FramedFlit<F>> : std::true_type {};
+
+// the valid mask of a flit with n (1 .. W) valid elements
+template <int W> constexpr MaskT<W> validMask(int n) {
+  using M = MaskT<W>;
+  return (n >= W) ? (M)~M(0) : (M)((M(1) << n) - 1);
+}
+
+// The stream a flit of a tagged datapath belongs to, sent alongside
+// it (see prefixSumBTagged() in scan.h); restart starts the stream's
+// scan over at this flit.
+struct StreamTag {
+  uint32_t id;
+  bool restart;
+};
+
+// -DFRAMED=1 builds the test datapaths with framed pipes
+#ifndef FRAMED
+#define FRAMED 0
+#endif
+
+// number of rotating carries prefixSumB() keeps for its running sum.
+// The carry update then only needs to finish in CARRY_LANES cycles,
+// so set this to the adder latency (about 4 for double FADD) to hold
+// II=1 at the fixed-point clock.  1 is the plain single accumulator.
+#ifndef CARRY_LANES
+#define CARRY_LANES (1)
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// Declare Streaming Pipes
+//
+// Note: in SYCL, pipes are "types" with fixed reader and
+// writers. Pipes cannot be passed around as variables.
+//
+// Programmer must set minimum pipe depth to avoid deadlock. Compiler
+// will adjust depth for performance.
+//
+// StreamPipes<Tag, T> is the set of pipes for one pipeline instance.
+// Each Tag gives a distinct set of pipe types, and so distinct FIFOs,
+// which is how several pipelines share one bitstream.  Segmented
+// selects flits with segment-head sideband (SegFlitT), W the number
+// of elements per flit, TAcc the type of the partial sums on SumPipe
+// (see AccumOf in scan.h), Framed flits with valid and end-of-stream
+// sideband (FramedFlit), and TDepths the pipes' depths (PipeDepths).
+// Flit is what the pipes carry; prefixSumB() sees a flit's eos
+// together with its partial sum, so SumPipe does not repeat it.
+//
+// ABPipe is the alternative to DataPipe and SumPipe: one pipe of
+// ABTokens, each a flit with its partial sum.  prefixSumA() then has
+// one handshake per flit instead of two, the compiler one FIFO to
+// allocate, as wide as both, and the flit and its sum can never be
+// skewed apart.  -DMERGED_AB_PIPE=1 builds the A/B kernels over it;
+// compare the RAM use and fmax of the two in the mini_link reports.
+//
+// Kernels find their flit type from the pipes they are given, with
+// PipeData<>.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef DEFAULT_PIPE_DEPTH
+#define DEFAULT_PIPE_DEPTH (4)
+#endif
+
+#ifndef MERGED_AB_PIPE
+#define MERGED_AB_PIPE 0
+#endif
+
+// The depths of the four pipes of a StreamPipes.  DerivedDepths (in
+// scan.h) works them out from the stages' latencies instead.
+template <int In = DEFAULT_PIPE_DEPTH, int Data = DEFAULT_PIPE_DEPTH,
+          int Sum = DEFAULT_PIPE_DEPTH, int Out = DEFAULT_PIPE_DEPTH>
+struct PipeDepths {
+  static_assert(In >= 1 && Data >= 1 && Sum >= 1 && Out >= 1,
+                "a pipe needs a depth of at least 1");
+  static constexpr int in = In;
+  static constexpr int data = Data;
+  static constexpr int sum = Sum;
+  static constexpr int out = Out;
+};
+
+template <typename Tag> class InPipe_id;
+template <typename Tag> class OutPipe_id;
+template <typename Tag> class DataPipe_id;
+template <typename Tag> class SumPipe_id;
+template <typename Tag> class ABPipe_id;
+
+// a flit and its partial sum, as one token
+template <typename F, typename TCarry> struct ABToken {
+  F flit;
+  TCarry partialSum;
+};
+
+template <typename Tag, typename T = Element, bool Segmented = false,
+          int W = defaultWidth<T>(), typename TAcc = T, bool Framed = false,
+          typename TDepths = PipeDepths<>>
+struct StreamPipes {
+  using Flit = PipeFlit<T, Segmented, W, Framed>;
+  using Depths = TDepths;
+
+  // from data source to kernel pipeline
+  using InPipe = sycl::ext::intel::pipe<InPipe_id<Tag>, Flit, TDepths::in>;
+  // from kernel to data sink
+  using OutPipe =
+      sycl::ext::intel::pipe<OutPipe_id<Tag>, Flit, TDepths::out>;
+
+  // The above is all you need for prefixSumSimple();
+  // The below are intermediate pipes between the 2 parts prefixSumA()
+  // and prefixSumB();
+  using DataPipe =
+      sycl::ext::intel::pipe<DataPipe_id<Tag>, Flit, TDepths::data>;
+  using SumPipe = sycl::ext::intel::pipe<SumPipe_id<Tag>,
+                                         StreamCarry<TAcc, Segmented>,
+                                         TDepths::sum>;
+  // or both in one pipe, as deep as DataPipe
+  using ABPipe = sycl::ext::intel::pipe<
+      ABPipe_id<Tag>, ABToken<Flit, StreamCarry<TAcc, Segmented>>,
+      TDepths::data>;
+};
+
+// what a pipe carries
+template <typename TPipe>
+using PipeData =
+    std::remove_cv_t<std::remove_reference_t<decltype(TPipe::read())>>;
+
+//////////////////////////////////////////////////////////////////////////////
+// Pipeline helpers
+//////////////////////////////////////////////////////////////////////////////
+
+// pin a value into a register (a pipeline stage boundary)
+template <typename T> T stageReg(T x) {
+#if FPGA_EMULATOR || FPGA_HARDWARE || FPGA_SIMULATOR
+  return sycl::ext::intel::fpga_reg(x);
+#else
+  return x;
+#endif
+}
+
+// the levels of a balanced tree over n leaves, ceil(log2(n))
+constexpr int log2Ceil(int n) {
+  return (n <= 1) ? 0 : 1 + log2Ceil((n + 1) / 2);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "host_io.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Tagged streams
+//
+// Replicating the pipeline per stream (see lanes.h) costs a whole
+// datapath per tenant, which is wasted on many small streams.  A
+// tagged datapath, Tagged<P, N>, instead time-multiplexes up to N
+// streams over P's one pipeline, flit by flit, in any interleaving:
+//
+//   TaggedSource --> prefixSumA --> prefixSumBTagged --> sink
+//         |                               ^
+//         +----------- TagPipe -----------+
+//
+// The host hands the source a StreamTag per flit, the stream it
+// belongs to and whether that stream starts over there.  prefixSumA()
+// reduces flits as usual, it does not care whose they are, and the
+// tag goes on a side pipe to prefixSumBTagged(), which keeps every
+// stream's running sum in an on-chip table (see scan.h).  The table's
+// size N is fixed by the build, but which of the N ids are in use,
+// and how their flits are interleaved, is up to the host.
+//
+// A stream's first flit must have restart set, or it carries on from
+// whatever its id last left in the table, as it does across launches.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef TAGGED_STREAMS
+#define TAGGED_STREAMS 0
+#endif
+
+template <typename P> class TaggedInput2Pipe;
+
+// Launch a kernel that reads nflits flits and their tags from USM
+// memory into P's InPipe and TagPipe.
+template <typename P>
+sycl::event submitTaggedSource(sycl::queue &q, const typename P::Flit *src_,
+                               const StreamTag *tags_, int64_t nflits,
+                               const std::vector<sycl::event> &deps = {}) {
+  static_assert(P::streams > 0, "P is not a tagged datapath");
+  using InPipe = typename P::Pipes::InPipe;
+  using TagPipe = typename P::TagPipe;
+  SourcePtr<const typename P::Flit> src = src_;
+  SourceWordPtr<const StreamTag> tags = tags_;
+  return q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.single_task<TaggedInput2Pipe<P>>([=]() {
+      [[intel::initiation_interval(1)]] // insist II=1 schedule
+      for (int64_t f = 0; f < nflits; f++) {
+        TagPipe::write(tags[f]);
+        InPipe::write(src[f]);
+      }
+    });
+  });
+}
+
+// Streams the nflits flits of in, tagged with tags, through tagged
+// datapath P into out, in one batch staged through device memory
+// unless ZERO_COPY.
+template <typename P>
+StreamEvents streamTagged(sycl::queue &q, const typename P::Flit *in,
+                          const StreamTag *tags, typename P::Flit *out,
+                          int64_t nflits) {
+  using F [[maybe_unused]] = typename P::Flit;
+  for (int64_t f = 0; f < nflits; f++) {
+    if (tags[f].id >= (uint32_t)P::streams) {
+      std::cerr << "ERROR: flit " << f << " of stream " << tags[f].id
+                << ", the datapath has " << P::streams << " streams\n";
+      std::terminate();
+    }
+  }
+
+  StreamEvents ev;
+#if ZERO_COPY
+  ev.lastSink = submitSink<P>(q, out, nflits);
+  ev.firstSource = submitTaggedSource<P>(q, in, tags, nflits);
+  ev.lastSource = ev.firstSource;
+  ev.done = ev.lastSink;
+  ev.done.wait();
+#else
+  F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+  F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+  StreamTag *dtags = mallocStream<StreamTag>(nflits, q, SOURCE_LOCATION);
+  sycl::event copyIn = q.memcpy(din, in, nflits * sizeof(F));
+  sycl::event copyTags = q.memcpy(dtags, tags, nflits * sizeof(StreamTag));
+  ev.lastSink = submitSink<P>(q, dout, nflits);
+  ev.firstSource =
+      submitTaggedSource<P>(q, din, dtags, nflits, {copyIn, copyTags});
+  ev.lastSource = ev.firstSource;
+  ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.lastSink);
+  ev.done.wait();
+  sycl::free(din, q);
+  sycl::free(dout, q);
+  sycl::free(dtags, q);
+#endif
+  return ev;
+}
+
+// Checks the nflits flits of out against a scan of each stream of in
+// on its own, in tag order.  Returns the index of the first wrong
+// element, or -1.
+template <typename P>
+int64_t verifyTagged(const typename P::Flit *in, const StreamTag *tags,
+                     const typename P::Flit *out, int64_t nflits) {
+  using A = typename P::Acc;
+  using Acc = AccumOf<typename P::Op>;
+  constexpr int W = P::width;
+  std::vector<A> sums(P::streams, Acc::Op::identity());
+  for (int64_t f = 0; f < nflits; f++) {
+    A &sum = sums[tags[f].id];
+    if (tags[f].restart) {
+      sum = Acc::Op::identity();
+    }
+    for (int j = 0; j < W; j++) {
+      sum = Acc::Op::apply(sum, Acc::lift(in[f].element[j]));
+      if (!(out[f].element[j] == Acc::lower(sum))) {
+        return f * W + j;
+      }
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "stream.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Telemetry
+//
+// With -DTELEMETRY=1 the source, prefixSumA(), prefixSumB() and sink
+// kernels are built in counted versions.  These use non-blocking pipe
+// reads and writes, so each loop iteration is exactly one of
+//
+//   active:       took in a flit (or, for the sink, a flit out)
+//   read stall:   its input pipe was empty
+//   write stall:  its output pipe was full, holding on to a flit
+//
+// plus a count of flits.  At II=1 an iteration is a clock cycle,
+// except where the kernel itself is stalled on memory; a source or
+// sink stuck on DDR shows up as the other end of its pipe stalling.
+// The stage with the fewest stalls of either kind is the bottleneck,
+// and (active + write stalls) / flits is the II it actually achieved.
+// Each stage also counts its runs of consecutive write stalls and the
+// longest one: a run is a time its output pipe was full, so a long
+// longest run with occasional runs is memory jitter a deeper pipe
+// would absorb (see "Pipe depths" in scan.h), while many short runs
+// are a downstream stage that is simply slower.
+//
+// The counters go to device memory: the source and sink add theirs in
+// when they finish, and the never-ending A and B kernels store a copy
+// whenever they run dry, at the first read stall after a flit or a
+// write stall.  After a run's last flit that copy is the run's final
+// count, up to and including that stall, so waitTelemetry() can wait
+// for it rather than for a guessed time.  A and B spin while idle, so
+// their read stalls include the time between runs; compare snapshots
+// taken around a run.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+
+enum Stage : int { kStageSource, kStageA, kStageB, kStageSink, kStages };
+
+struct StageStats {
+  uint64_t active;
+  uint64_t readStalls;
+  uint64_t writeStalls;
+  uint64_t flits;
+  uint64_t stallRuns;    // runs of consecutive write stalls
+  uint64_t longestStall; // the longest, in iterations
+};
+
+// a kernel's counters, and the non-blocking pipe access they count
+struct StageCounter {
+  StageStats s = {0, 0, 0, 0, 0, 0};
+  uint64_t run = 0;    // write stalls since the last other iteration
+  bool dry = false;    // this iteration was a read stall
+  bool wasDry = true;  // and the one before
+
+  // count one iteration as what it was
+  void active() {
+    s.active++;
+    s.flits++;
+    run = 0;
+    dry = false;
+  }
+  void readStall() {
+    s.readStalls++;
+    run = 0;
+    dry = true;
+  }
+  void writeStall() {
+    s.writeStalls++;
+    dry = false;
+    s.stallRuns += (run == 0);
+    run++;
+    s.longestStall = (run > s.longestStall) ? run : s.longestStall;
+  }
+
+  // try to read TPipe into v; a false return is the iteration's stall
+  template <typename TPipe> bool tryRead(PipeData<TPipe> &v) {
+    bool ok = false;
+    v = TPipe::read(ok);
+    return ok;
+  }
+
+  template <typename TPipe> bool tryWrite(const PipeData<TPipe> &v) {
+    bool ok = false;
+    TPipe::write(v, ok);
+    return ok;
+  }
+
+  // store the counters when the kernel runs dry, once per iteration
+  // of a never-ending kernel
+  void flushIdle(StageStats *dst) {
+    if (dry && !wasDry) {
+      *dst = s;
+    }
+    wasDry = dry;
+  }
+
+  // add the counters into *dst, for kernels that finish
+  void accumulate(StageStats *dst) {
+    StageStats d = *dst;
+    d.active += s.active;
+    d.readStalls += s.readStalls;
+    d.writeStalls += s.writeStalls;
+    d.flits += s.flits;
+    d.stallRuns += s.stallRuns;
+    d.longestStall =
+        (s.longestStall > d.longestStall) ? s.longestStall : d.longestStall;
+    *dst = d;
+  }
+};
+
+// kStages counters of datapath P, zeroed at first use
+template <typename P> StageStats *telemetryStats(sycl::queue &q) {
+  static StageStats *stats = nullptr;
+  if (!stats) {
+    stats = sycl::malloc_device<StageStats>(kStages, q);
+    q.memset(stats, 0, kStages * sizeof(StageStats)).wait();
+  }
+  return stats;
+}
+
+template <typename P> std::vector<StageStats> readTelemetry(sycl::queue &q) {
+  std::vector<StageStats> snap(kStages);
+  q.memcpy(snap.data(), telemetryStats<P>(q), kStages * sizeof(StageStats))
+      .wait();
+  return snap;
+}
+
+// A snapshot once A and B have stored the counts of at least nflits
+// flits more than in before, which they do when they run dry after
+// the last of them; the source and sink have finished by then.
+template <typename P>
+std::vector<StageStats> waitTelemetry(sycl::queue &q,
+                                      const std::vector<StageStats> &before,
+                                      uint64_t nflits) {
+  std::vector<StageStats> snap = readTelemetry<P>(q);
+  while (snap[kStageA].flits < before[kStageA].flits + nflits ||
+         snap[kStageB].flits < before[kStageB].flits + nflits) {
+    snap = readTelemetry<P>(q);
+  }
+  return snap;
+}
+
+// per-stage counts between two snapshots; the longest stall is since
+// the counters were zeroed
+inline void reportTelemetry(const std::vector<StageStats> &before,
+                            const std::vector<StageStats> &after) {
+  static const char *names[kStages] = {"source", "prefixSumA", "prefixSumB",
+                                       "sink"};
+  std::ios saved(nullptr);
+  saved.copyfmt(std::cout);
+  std::cout << "stage        flits      active   readStall  writeStall   II"
+            << "   runs longest" << std::endl;
+  for (int k = 0; k < kStages; k++) {
+    uint64_t flits = after[k].flits - before[k].flits;
+    uint64_t active = after[k].active - before[k].active;
+    uint64_t rs = after[k].readStalls - before[k].readStalls;
+    uint64_t ws = after[k].writeStalls - before[k].writeStalls;
+    uint64_t runs = after[k].stallRuns - before[k].stallRuns;
+    double ii = flits ? (double)(active + ws) / flits : 0.0;
+    std::cout << std::left << std::setw(11) << names[k] << std::right
+              << std::setw(8) << flits << std::setw(12) << active
+              << std::setw(12) << rs << std::setw(12) << ws << std::setw(7)
+              << std::fixed << std::setprecision(2) << ii << std::setw(7)
+              << runs << std::setw(8) << after[k].longestStall << std::endl;
+  }
+  std::cout.copyfmt(saved);
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "scan.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Host-side parallel helpers
+//
+// Filling and checking a 16M-element stream one element at a time
+// takes longer than the kernels do under emulation.  parallelFor()
+// splits a range of flits over HOST_THREADS host threads (0: one per
+// core).  verifyScan() checks an output against an inclusive scan of
+// its input, block-parallel, without storing the reference:
+//
+//   1. each thread reduces its block of flits to one carry
+//   2. the block carries are scanned in order into each block's
+//      carry-in (a handful of apply()s)
+//   3. each thread re-scans its block from its carry-in, comparing
+//
+// Regrouping the scan this way is exact for the integer operators, for
+// ExactSumOp, and for sums of doubles that stay integers below 2^53,
+// like the test input; other floating-point inputs need a tolerance.
+// A double EwmaOp rounds differently in every grouping; check it with
+// verifyMirror().
+// Like the kernels, the reference accumulates in the operator's
+// accumulator type (AccumOf) and lowers each prefix to compare it.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_THREADS
+#define HOST_THREADS 0
+#endif
+
+inline int hostThreads() {
+  int n = HOST_THREADS;
+  if (n <= 0) {
+    n = (int)std::thread::hardware_concurrency();
+  }
+  return std::max(1, n);
+}
+
+// how many blocks parallelFor() cuts n into
+inline int hostBlocks(int64_t n) {
+  return (int)std::max<int64_t>(1, std::min<int64_t>(hostThreads(), n));
+}
+
+// f(t, begin, end) on [0, n) cut into hostBlocks(n) blocks, t the
+// block index, each on its own thread
+template <typename Fn> void parallelFor(int64_t n, Fn &&f) {
+  int nt = hostBlocks(n);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nt; t++) {
+    int64_t begin = n * t / nt;
+    int64_t end = n * (t + 1) / nt;
+    threads.emplace_back([&f, t, begin, end]() { f(t, begin, end); });
+  }
+  for (std::thread &th : threads) {
+    th.join();
+  }
+}
+
+// Segment heads of the scan under check: the flits' own heads, if P
+// is segmented, and the first element of the flits listed in starts
+// (sorted).
+template <typename P> struct ScanHeads {
+  const typename P::Flit *in;
+  const std::vector<int64_t> &starts;
+
+  bool operator()(int64_t f, int j) const {
+    bool head = false;
+    if constexpr (P::segmented) {
+      head = ((in[f].heads >> j) & 1) != 0;
+    }
+    return head ||
+           (j == 0 && std::binary_search(starts.begin(), starts.end(), f));
+  }
+};
+
+// passes 1 and 2: the carry into each of the hostBlocks(nflits)
+// blocks of the scan of the first n elements of in
+template <typename P>
+std::vector<typename P::Acc>
+blockCarries(const typename P::Flit *in, int64_t n, const ScanHeads<P> &isHead,
+             typename P::Acc carry) {
+  using A = typename P::Acc;
+  using Acc = AccumOf<typename P::Op>;
+  using SOp = SegmentedOp<typename Acc::Op>;
+  constexpr int W = P::width;
+  int64_t nflits = (n + W - 1) / W;
+
+  // block totals, as Seg<A> so heads inside a block reset the carry
+  int nt = hostBlocks(nflits);
+  std::vector<Seg<A>> total(nt, SOp::identity());
+  parallelFor(nflits, [&](int t, int64_t begin, int64_t end) {
+    Seg<A> s = SOp::identity();
+    for (int64_t f = begin; f < end; f++) {
+      int m = (int)std::min<int64_t>(W, n - f * W);
+      for (int j = 0; j < m; j++) {
+        s = SOp::apply(s, {Acc::lift(in[f].element[j]), isHead(f, j)});
+      }
+    }
+    total[t] = s;
+  });
+
+  std::vector<A> carryIn(nt);
+  Seg<A> running = {carry, false};
+  for (int t = 0; t < nt; t++) {
+    carryIn[t] = running.value;
+    running = SOp::apply(running, total[t]);
+  }
+  return carryIn;
+}
+
+// Whether got and expected, two roundings of the same sum of terms
+// in different orders, are within ulps epsilons per add of the
+// sum of magnitudes absSum.  Any order of adds is within
+// (terms - 1) * epsilon * absSum of the exact sum, so ulps = 2 accepts
+// any pair of orders.
+template <typename T>
+bool sumClose(T expected, T got, T absSum, int64_t terms, int ulps) {
+  return std::fabs(got - expected) <=
+         ulps * std::numeric_limits<T>::epsilon() * terms * absSum;
+}
+
+// Checks the first n elements of out against the scan of in, carried
+// on from carry, in the accumulator type, and restarted at heads as in
+// ScanHeads.  With ulps > 0,
+// floating-point sums need only be within sumClose() (ulps per add);
+// everything else is compared exactly.  Returns the index of the first
+// wrong element, or -1.
+template <typename P>
+int64_t verifyScan(const typename P::Flit *in, const typename P::Flit *out,
+                   int64_t n, const std::vector<int64_t> &starts,
+                   typename P::Acc carry, int ulps = 0) {
+  using T = typename P::Value;
+  using A = typename P::Acc;
+  using Acc = AccumOf<typename P::Op>;
+  constexpr int W = P::width;
+  int64_t nflits = (n + W - 1) / W;
+  ScanHeads<P> isHead{in, starts};
+  std::vector<A> carryIn = blockCarries<P>(in, n, isHead, carry);
+
+  // pass 3: check each block, keeping the lowest mismatch
+  std::atomic<int64_t> first(n);
+  parallelFor(nflits, [&](int t, int64_t begin, int64_t end) {
+    A prefixSum = carryIn[t];
+    // error bound terms since the last head; the carry-in stands for
+    // the terms before the block, by its magnitude (theirs, for
+    // non-negative terms) and their count
+    T absSum{};
+    int64_t terms = begin * W;
+    if constexpr (IsFloatSum<typename P::Op>::value) {
+      absSum = std::fabs(Acc::lower(prefixSum));
+    }
+    for (int64_t f = begin; f < end; f++) {
+      if (f * W >= first.load(std::memory_order_relaxed)) {
+        return;
+      }
+      int m = (int)std::min<int64_t>(W, n - f * W);
+      for (int j = 0; j < m; j++) {
+        if (isHead(f, j)) {
+          prefixSum = Acc::Op::identity();
+          absSum = T{};
+          terms = 0;
+        }
+        prefixSum = Acc::Op::apply(prefixSum, Acc::lift(in[f].element[j]));
+        T expected = Acc::lower(prefixSum);
+        bool ok;
+        if constexpr (IsFloatSum<typename P::Op>::value) {
+          absSum += std::fabs(in[f].element[j]);
+          terms++;
+          ok = (ulps > 0) ? sumClose(expected, out[f].element[j], absSum,
+                                     terms, ulps)
+                          : expected == out[f].element[j];
+        } else {
+          ok = expected == out[f].element[j];
+        }
+        if (!ok) {
+          int64_t i = f * W + j;
+          int64_t seen = first.load();
+          while (i < seen && !first.compare_exchange_weak(seen, i)) {
+          }
+          return;
+        }
+      }
+    }
+  });
+
+  return (first.load() < n) ? first.load() : -1;
+}
+
+// Checks the first n elements of out against a scan of in over a
+// sliding window of the last window elements (see prefixSumBWindow()).
+// The reference is van Herk/Gil-Werman: the stream is cut into blocks
+// of window elements, and the window of element r of block b is the
+// scan of block b-1 from r+1 on, then of block b up to r, so each
+// block costs a reverse and a forward scan, block-parallel.  Compared
+// exactly.  Returns the index of the first wrong element, or -1.
+template <typename P>
+int64_t verifyWindowScan(const typename P::Flit *in,
+                         const typename P::Flit *out, int64_t n,
+                         int64_t window) {
+  using A = typename P::Acc;
+  using Acc = AccumOf<typename P::Op>;
+  using AOp = typename Acc::Op;
+  constexpr int W = P::width;
+  auto x = [&](int64_t i) { return Acc::lift(in[i / W].element[i % W]); };
+  int64_t nblocks = (n + window - 1) / window;
+
+  std::atomic<int64_t> first(n);
+  parallelFor(nblocks, [&](int, int64_t begin, int64_t end) {
+    std::vector<A> suffix(window + 1);
+    for (int64_t b = begin; b < end; b++) {
+      int64_t base = b * window;
+      if (base >= first.load(std::memory_order_relaxed)) {
+        return;
+      }
+      // suffix[r]: block b-1 from element r on
+      suffix[window] = AOp::identity();
+      for (int64_t r = window - 1; r >= 0; r--) {
+        suffix[r] =
+            (b > 0) ? AOp::apply(x(base - window + r), suffix[r + 1])
+                    : AOp::identity();
+      }
+      A prefix = AOp::identity();
+      for (int64_t r = 0; r < window && base + r < n; r++) {
+        int64_t i = base + r;
+        prefix = AOp::apply(prefix, x(i));
+        typename P::Value expected =
+            Acc::lower(AOp::apply(suffix[r + 1], prefix));
+        if (!(expected == out[i / W].element[i % W])) {
+          int64_t seen = first.load();
+          while (i < seen && !first.compare_exchange_weak(seen, i)) {
+          }
+          return;
+        }
+      }
+    }
+  });
+  return (first.load() < n) ? first.load() : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Order-mirroring reference
+//
+// mirrorScan() computes the scan the way prefixSumA()/prefixSumB() do:
+// the same flitReduce(), CarryLanes and flitScan() code, so the same
+// network, the same carry-lane regrouping and (KAHAN_CARRY) the same
+// compensation, in the same order.  With IEEE arithmetic and no
+// contraction on either side, a double scan then matches the device
+// bit for bit however the kernels reassociate.  The flit reductions
+// and the flit scans are independent and run across the host
+// threads; only the carry chain, one apply() per flit, is serial.
+//
+// carry seeds the carry lanes as submitPrefixSumAB() would; with
+// CARRY_LANES > 1 a carry from a previous run only mirrors the
+// device's lanes if that run ended on the same lane.  scanCarry() is
+// the carry a run hands on, for checking the next one.
+//////////////////////////////////////////////////////////////////////////////
+
+template <typename P>
+void mirrorScan(const typename P::Flit *in, typename P::Flit *out,
+                int64_t nflits, const std::vector<int64_t> &starts,
+                typename P::Acc carry) {
+  using A = typename P::Acc;
+  using F = typename P::Flit;
+  using Op = typename P::Op;
+  using AOp = typename AccumOf<Op>::Op;
+  using Scan = typename P::Scan;
+  constexpr bool Segmented = P::segmented;
+
+  // a restart is a head on the flit's first element, as submitSource()
+  // marks it
+  auto flitAt = [&](int64_t f) {
+    F flit = in[f];
+    if constexpr (Segmented) {
+      if (std::binary_search(starts.begin(), starts.end(), f)) {
+        flit.heads |= 1;
+      }
+    }
+    return flit;
+  };
+
+  std::vector<StreamCarry<A, Segmented>> partial(nflits);
+  parallelFor(nflits, [&](int, int64_t begin, int64_t end) {
+    for (int64_t f = begin; f < end; f++) {
+      partial[f] = flitReduce<Op, Scan>(flitAt(f));
+    }
+  });
+
+  std::vector<A> before(nflits);
+  CarryLanes<AOp, defaultCarryLanes<Op, F>(), Segmented> lanes(carry);
+  for (int64_t f = 0; f < nflits; f++) {
+    before[f] = lanes.sum();
+    lanes.add(partial[f]);
+  }
+
+  parallelFor(nflits, [&](int, int64_t begin, int64_t end) {
+    for (int64_t f = begin; f < end; f++) {
+      out[f] = flitScan<Op, Scan>(before[f], flitAt(f));
+      if constexpr (Segmented) {
+        out[f].heads = in[f].heads;
+      }
+    }
+  });
+}
+
+// Checks the nflits flits of out bit for bit against mirrorScan().
+// Returns the index of the first wrong element, or -1.
+template <typename P>
+int64_t verifyMirror(const typename P::Flit *in, const typename P::Flit *out,
+                     int64_t nflits, const std::vector<int64_t> &starts,
+                     typename P::Acc carry) {
+  constexpr int W = P::width;
+  std::vector<typename P::Flit> ref(nflits);
+  mirrorScan<P>(in, ref.data(), nflits, starts, carry);
+
+  std::atomic<int64_t> first(nflits * W);
+  parallelFor(nflits, [&](int, int64_t begin, int64_t end) {
+    for (int64_t f = begin; f < end; f++) {
+      for (int j = 0; j < W; j++) {
+        if (std::memcmp(&ref[f].element[j], &out[f].element[j],
+                        sizeof(ref[f].element[j])) != 0) {
+          int64_t i = f * W + j;
+          int64_t seen = first.load();
+          while (i < seen && !first.compare_exchange_weak(seen, i)) {
+          }
+          return;
+        }
+      }
+    }
+  });
+  return (first.load() < nflits * W) ? first.load() : -1;
+}
+
+// The carry the A/B kernels hand on after the nflits flits of in,
+// starting from carry: each flit's flitReduce() applied in order, as
+// prefixSumB() does with a single carry lane, so it mirrors the
+// device's carry whenever mirrorScan() does.  Kept in the accumulator
+// type, since lowering it would round an ExactSumOp sum and lose the
+// a of an EwmaOp step.
+template <typename P>
+typename P::Acc scanCarry(const typename P::Flit *in, int64_t nflits,
+                          typename P::Acc carry) {
+  using Op = typename P::Op;
+  using AOp = typename AccumOf<Op>::Op;
+  for (int64_t f = 0; f < nflits; f++) {
+    auto partialSum = flitReduce<Op, typename P::Scan>(in[f]);
+    if constexpr (P::segmented) {
+      carry = partialSum.head ? partialSum.value
+                              : AOp::apply(carry, partialSum.value);
+    } else {
+      carry = AOp::apply(carry, partialSum);
+    }
+  }
+  return carry;
+}
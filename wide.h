@@ -0,0 +1,230 @@
+#pragma once
+
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "lanes.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Wide streams
+//
+// One flit is 64 bytes, so one datapath moves at most 64 B per cycle.
+// A wide stream spreads one logical stream over M flit lanes: the
+// stream is cut into rows of M flits, and flit l of every row goes to
+// lane l.
+//
+//                  +-> A[0] -- DataPipe --> C[0] -+
+//   WideSource ----+-> A[1] -- DataPipe --> C[1] -+---> WideSink
+//                  +-> ...       SumPipes   ...   +
+//                        \        |         /
+//                         +--> Combine ---+  CarryPipes
+//
+// Each lane has its own prefixSumA().  Combine reads the M flit sums of
+// a row, scans them across the lanes and hands each lane the running
+// sum before its flit; C[l] then scans its flit from that carry.  The
+// only loop-carried apply() is Combine's running sum plus the row
+// total, the same one prefixSumB() has, so the result is still one
+// exact scan, at M flits per cycle.
+//
+// The source and sink move whole rows, M flits of contiguous memory,
+// so their LSUs are M*64 bytes wide.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef WIDE_LANES
+#define WIDE_LANES 1
+#endif
+
+template <typename Tag> class CarryPipe_id;
+
+template <typename Tag> class WideSource;
+template <typename Tag> class WideSink;
+template <typename Tag> class WideCombine_k;
+template <typename Tag> class LaneScan_k;
+
+// the tag of a wide stream over datapath P; its lanes are
+// Replicated<Wide<P, M>, l>
+template <typename P, int M> struct Wide : P {};
+
+template <typename Fn, int... Ls>
+void forLanesImpl(Fn &f, std::integer_sequence<int, Ls...>) {
+  (f(std::integral_constant<int, Ls>{}), ...);
+}
+
+// call f(std::integral_constant<int, L>{}) for L = 0 .. M-1; pipes are
+// types, so a loop over lanes has to be unrolled at compile time
+template <int M, typename Fn> void forLanes(Fn &&f) {
+  forLanesImpl(f, std::make_integer_sequence<int, M>{});
+}
+
+template <typename P, int M = WIDE_LANES> struct WideStream {
+  static_assert(M >= 1 && (M & (M - 1)) == 0,
+                "WIDE_LANES must be a power of 2");
+  static_assert(!P::framed, "wide streams move whole rows of flits");
+
+  using T = typename P::Acc; // the sums are in the accumulator type
+  using F = typename P::Flit;
+  using C = StreamCarry<T, P::segmented>;
+  using AOp = typename AccumOf<typename P::Op>::Op;
+  using Op = std::conditional_t<P::segmented, SegmentedOp<AOp>, AOp>;
+
+  template <int L> using Lane = Replicated<Wide<P, M>, L>;
+  template <int L> using LanePipes = typename Lane<L>::Pipes;
+  // combine -> C[L]: running sum before lane L's flit; a SumPipe to
+  // the lane
+  template <int L>
+  using CarryPipe =
+      sycl::ext::intel::pipe<CarryPipe_id<Lane<L>>, T, P::Depths::sum>;
+
+  // launch the kernels of every lane and the combine stage,
+  // back-to-front; they never terminate
+  static void launch(sycl::queue &q) {
+    forLanes<M>([&](auto l) {
+      constexpr int L = decltype(l)::value;
+      q.submit([&](sycl::handler &h) {
+        h.single_task<LaneScan_k<Lane<L>>>([=]() { laneScan<L>(); });
+      });
+    });
+
+    q.submit([&](sycl::handler &h) {
+      h.single_task<WideCombine_k<Wide<P, M>>>([=]() { combine(); });
+    });
+
+    forLanes<M>([&](auto l) {
+      constexpr int L = decltype(l)::value;
+      using Pp = LanePipes<L>;
+      q.submit([&](sycl::handler &h) {
+        h.single_task<PrefixSumA_k<Lane<L>>>([=]() {
+          prefixSumA<typename Pp::InPipe, typename Pp::SumPipe,
+                     typename Pp::DataPipe, typename P::Op,
+                     typename P::Scan>();
+        });
+      });
+    });
+  }
+
+  // Launch a kernel that moves nrows rows of M flits from USM memory
+  // to the lanes.
+  static sycl::event submitSource(sycl::queue &q, const F *src_,
+                                  int64_t nrows,
+                                  const std::vector<sycl::event> &deps = {}) {
+    SourcePtr<const F> src = src_;
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<WideSource<Wide<P, M>>>([=]() {
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        for (int64_t r = 0; r < nrows; r++) {
+          forLanes<M>([&](auto l) {
+            constexpr int L = decltype(l)::value;
+            LanePipes<L>::InPipe::write(src[r * M + L]);
+          });
+        }
+      });
+    });
+  }
+
+  // Launch a kernel that moves nrows rows of M flits from the lanes to
+  // USM memory.
+  static sycl::event submitSink(sycl::queue &q, F *dst_, int64_t nrows,
+                                const std::vector<sycl::event> &deps = {}) {
+    SinkPtr<F> dst = dst_;
+    return q.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.single_task<WideSink<Wide<P, M>>>([=]() {
+        [[intel::initiation_interval(1)]] // insist II=1 schedule
+        for (int64_t r = 0; r < nrows; r++) {
+          forLanes<M>([&](auto l) {
+            constexpr int L = decltype(l)::value;
+            dst[r * M + L] = LanePipes<L>::OutPipe::read();
+          });
+        }
+      });
+    });
+  }
+
+  // Streams nflits flits, a multiple of M, through the lanes in one
+  // batch, staged through device memory unless ZERO_COPY.
+  static StreamEvents run(sycl::queue &q, const F *in, F *out,
+                          int64_t nflits) {
+    if (nflits % M != 0) {
+      std::cerr << "ERROR: wide stream of " << nflits
+                << " flits is not a multiple of " << M << " lanes\n";
+      std::terminate();
+    }
+    int64_t nrows = nflits / M;
+
+    StreamEvents ev;
+#if ZERO_COPY
+    ev.lastSink = submitSink(q, out, nrows);
+    ev.firstSource = submitSource(q, in, nrows);
+    ev.lastSource = ev.firstSource;
+    ev.done = ev.lastSink;
+    ev.done.wait();
+#else
+    F *din = mallocStream<F>(nflits, q, SOURCE_LOCATION);
+    F *dout = mallocStream<F>(nflits, q, SINK_LOCATION);
+    sycl::event copyIn = q.memcpy(din, in, nflits * sizeof(F));
+    ev.lastSink = submitSink(q, dout, nrows);
+    ev.firstSource = submitSource(q, din, nrows, {copyIn});
+    ev.lastSource = ev.firstSource;
+    ev.done = q.memcpy(out, dout, nflits * sizeof(F), ev.lastSink);
+    ev.done.wait();
+    sycl::free(din, q);
+    sycl::free(dout, q);
+#endif
+    return ev;
+  }
+
+private:
+  static T carryValue(const C &c) {
+    if constexpr (P::segmented) {
+      return c.value;
+    } else {
+      return c;
+    }
+  }
+
+  // Scans the M flit sums of each row across the lanes.  The scan of
+  // the row and the per-lane offsets only read sumSoFar; the single
+  // loop-carried apply() adds the row total.
+  static void combine() {
+    C sumSoFar = Op::identity();
+
+    [[intel::initiation_interval(1)]] // insist II=1 schedule
+    while (1) {
+      C sums[M], incl[M];
+      forLanes<M>([&](auto l) {
+        constexpr int L = decltype(l)::value;
+        sums[L] = LanePipes<L>::SumPipe::read();
+      });
+
+      // running sums within the row, independent of sumSoFar
+      P::Scan::template scan<Op, M>(Op::identity(), sums, incl);
+
+      forLanes<M>([&](auto l) {
+        constexpr int L = decltype(l)::value;
+        if constexpr (L == 0) {
+          CarryPipe<L>::write(carryValue(sumSoFar));
+        } else {
+          CarryPipe<L>::write(carryValue(Op::apply(sumSoFar, incl[L - 1])));
+        }
+      });
+
+      sumSoFar = Op::apply(sumSoFar, incl[M - 1]);
+    }
+  }
+
+  // prefixSumB() without the loop-carried sum: the carry comes from
+  // combine()
+  template <int L> static void laneScan() {
+    using Pp = LanePipes<L>;
+
+    [[intel::initiation_interval(1)]] // insist II=1 schedule
+    while (1) {
+      F iflit = Pp::DataPipe::read();
+      T carry = CarryPipe<L>::read();
+      F oflit = flitScan<typename P::Op, typename P::Scan>(carry, iflit);
+      Pp::OutPipe::write(oflit);
+    }
+  }
+};